@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts the heap allocations made by the program, to check that the hot loops
+// of the solvers don't allocate. Replacing the global operator new affects the
+// whole program, which is one translation unit, so it's only replaced when
+// COUNT_ALLOCATIONS is defined, which the bench target of the Makefile does.
+// Other builds don't count anything and pay nothing for it. The array and
+// nothrow forms call this one.
+#ifdef COUNT_ALLOCATIONS
+
+std::atomic<long> heapAllocations{0};
+
+void* operator new(std::size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+// gcc can't tell that these are the replacements of the operator new above
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+// the number of heap allocations made so far, -1 if they aren't counted
+long heapAllocationCount() {
+#ifdef COUNT_ALLOCATIONS
+    return heapAllocations.load(std::memory_order_relaxed);
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+// The arcs of an instance that a tour may use: all of them but the forbidden
+// edges, and the ones from a city to itself. Real routing graphs leave most
+// of the n * (n - 1) arcs out, and then the solvers go over the arcs from
+// these lists instead of over whole rows of the matrix.
+//
+// The lists are in compressed sparse row form: the arcs leaving city u go to
+// outTargets[outOffsets[u]] .. outTargets[outOffsets[u + 1] - 1], and the ones
+// entering it come from the same range of inSources, both in increasing
+// order. They're only built when at most SPARSE_ARCS_DENSITY of the arcs are
+// allowed, as otherwise going over a row of the matrix is faster anyway.
+struct AllowedArcs {
+    int n = 0;
+    // number of allowed arcs
+    int64_t count = 0;
+    // whether every city has an allowed arc leaving it and one entering it,
+    // without which there's no tour at all
+    bool everyCityLinked = true;
+    // whether the lists below are built
+    bool listed = false;
+    std::vector<int64_t> outOffsets, inOffsets;
+    std::vector<int> outTargets, inSources;
+
+    AllowedArcs() = default;
+
+    // `forbidden(from, to)` tells whether a tour may not use the arc
+    template <typename Forbidden>
+    AllowedArcs(int _n, Forbidden&& forbidden, double sparseDensity) : n(_n) {
+        std::vector<int64_t> outDegree(n, 0), inDegree(n, 0);
+        for (int from = 0; from < n; ++from) {
+            for (int to = 0; to < n; ++to) {
+                if (forbidden(from, to)) continue;
+                ++outDegree[from];
+                ++inDegree[to];
+            }
+        }
+        for (int city = 0; city < n; ++city) {
+            count += outDegree[city];
+            if (n > 1 && (outDegree[city] == 0 || inDegree[city] == 0)) everyCityLinked = false;
+        }
+        if (count > sparseDensity * n * (n - 1.0)) return;
+
+        listed = true;
+        outOffsets.assign(n + 1, 0);
+        inOffsets.assign(n + 1, 0);
+        for (int city = 0; city < n; ++city) {
+            outOffsets[city + 1] = outOffsets[city] + outDegree[city];
+            inOffsets[city + 1] = inOffsets[city] + inDegree[city];
+        }
+        outTargets.resize(count);
+        inSources.resize(count);
+
+        // the arcs are found in increasing order of both of their ends, so
+        // each list comes out sorted
+        std::vector<int64_t> inNext(inOffsets.begin(), inOffsets.end() - 1);
+        for (int from = 0; from < n; ++from) {
+            int64_t outNext = outOffsets[from];
+            for (int to = 0; to < n; ++to) {
+                if (forbidden(from, to)) continue;
+                outTargets[outNext++] = to;
+                inSources[inNext[to]++] = from;
+            }
+        }
+    }
+
+    // share of the n * (n - 1) arcs that are allowed
+    double density() const {
+        return n > 1 ? count / (n * (n - 1.0)) : 1;
+    }
+
+    // the cities that `city` has an allowed arc to, if the lists are built
+    std::span<const int> out(int city) const {
+        return {outTargets.data() + outOffsets[city], size_t(outOffsets[city + 1] - outOffsets[city])};
+    }
+
+    // the cities that have an allowed arc to `city`, if the lists are built
+    std::span<const int> in(int city) const {
+        return {inSources.data() + inOffsets[city], size_t(inOffsets[city + 1] - inOffsets[city])};
+    }
+};
+
+// the largest share of allowed arcs for which their lists are built
+const double SPARSE_ARCS_DENSITY = 0.5;
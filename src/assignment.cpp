@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Cost of an edge that may not be a part of the assignment. Large enough that
+// no real assignment reaches it, small enough that adding a few of them does
+// not overflow.
+const int64_t AP_FORBIDDEN = int64_t(1) << 40;
+
+// A solution of the assignment problem: every row (city leaving) is assigned
+// a column (city entered) so that the sum of the costs is minimal. Together
+// with the assignment, the dual variables of the rows and columns are kept, so
+// that after forbidding a few edges, the solution can be repaired with one
+// shortest path search per row that lost its column, O(n^2) each, instead of
+// solving the problem from scratch in O(n^3).
+//
+// The implementation is the shortest augmenting path variant of the Hungarian
+// method. Rows and columns are numbered from 1, index 0 is used by the search
+// as a virtual column the row being inserted starts from.
+struct Assignment {
+    std::vector<int64_t> u;
+    std::vector<int64_t> v;
+    // the row assigned to each column, 0 if none
+    std::vector<int> rowOf;
+
+    Assignment(int n) : u(n + 1, 0), v(n + 1, 0), rowOf(n + 1, 0) {}
+
+    int size() const { return rowOf.size() - 1; }
+
+    // the column (city) each row (city) is assigned to, numbered from 0
+    std::vector<int> successors() const {
+        std::vector<int> successor(size(), -1);
+        for(int j = 1; j <= size(); ++j) {
+            if(rowOf[j] != 0) successor[rowOf[j] - 1] = j - 1;
+        }
+        return successor;
+    }
+
+    // removes the assignment of a row, numbered from 0. The duals stay
+    // feasible, so the row can be inserted back with `insert`.
+    void unassign(int row) {
+        for(int j = 1; j <= size(); ++j) {
+            if(rowOf[j] == row + 1) rowOf[j] = 0;
+        }
+    }
+
+    // Assigns a row, numbered from 0, that has no column yet, moving the other
+    // rows along the cheapest augmenting path. `cost(i, j)` gives the costs,
+    // numbered from 0, which may only have grown since the duals were
+    // calculated. Returns false if the row can only be assigned through a
+    // forbidden edge.
+    template <typename Cost>
+    bool insert(int row, const Cost& cost) {
+        const int n = size();
+        std::vector<int64_t> minimum(n + 1, INT64_MAX);
+        std::vector<int> way(n + 1, 0);
+        std::vector<bool> used(n + 1, false);
+
+        rowOf[0] = row + 1;
+        int j0 = 0;
+        do {
+            used[j0] = true;
+            int i0 = rowOf[j0];
+            int64_t delta = INT64_MAX;
+            int j1 = 0;
+            for(int j = 1; j <= n; ++j) {
+                if(used[j]) continue;
+
+                int64_t current = cost(i0 - 1, j - 1) - u[i0] - v[j];
+                if(current < minimum[j]) {
+                    minimum[j] = current;
+                    way[j] = j0;
+                }
+                if(minimum[j] < delta) {
+                    delta = minimum[j];
+                    j1 = j;
+                }
+            }
+
+            if(delta >= AP_FORBIDDEN / 2) {
+                rowOf[0] = 0;
+                return false;
+            }
+
+            for(int j = 0; j <= n; ++j) {
+                if(used[j]) {
+                    u[rowOf[j]] += delta;
+                    v[j] -= delta;
+                }
+                else {
+                    minimum[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while(rowOf[j0] != 0);
+
+        // flip the edges along the path
+        do {
+            int j1 = way[j0];
+            rowOf[j0] = rowOf[j1];
+            j0 = j1;
+        } while(j0 != 0);
+        rowOf[0] = 0;
+
+        return true;
+    }
+};
@@ -0,0 +1,773 @@
+#pragma once
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <optional>
+
+#include "lib.h"
+#include "alloc_counter.cpp"
+#include "dynamic_programming.cpp"
+#include "branch_and_bound.cpp"
+#include "gatspsolver.cpp"
+
+// Microbenchmarks of the hot loops of the solvers. They are meant to be run
+// from an optimized build, see the bench target in the Makefile.
+
+// measures how many states per second the dynamic programming solution
+// calculates with each of the kernels of its innermost loop, on random
+// instances of sizes from min to max
+void benchDp(int min, int max) {
+    std::mt19937 gen(0);
+    const DpKernel kernels[] = { DpKernel::Scalar, DpKernel::Sse, DpKernel::Avx2 };
+
+    std::cout << "N";
+    for (DpKernel kernel : kernels) {
+        std::cout << "," << dpKernelName(kernel) << " [states/s]";
+    }
+    std::cout << std::endl;
+
+    for (int n = min; n <= max; ++n) {
+        DistanceMatrix<int> adjMatrix(genRandomInstance(n, gen), n);
+
+        // every set of the cities other than the start one, once for each
+        // city that the path through it can end in
+        double states = double(n - 1) * double(uint64_t(1) << (n - 2));
+
+        std::cout << n;
+        int scalarCost = -1;
+        for (DpKernel kernel : kernels) {
+            bool supported = kernel == DpKernel::Scalar
+                || (kernel == DpKernel::Sse && __builtin_cpu_supports("sse4.1"))
+                || (kernel == DpKernel::Avx2 && __builtin_cpu_supports("avx2"));
+            if (!supported) {
+                std::cout << ",-";
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            TspSolution solution = tspDp(adjMatrix, n, 1, kernel);
+            auto end = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(end - start).count();
+
+            if (scalarCost == -1) scalarCost = solution.cost;
+            if (solution.cost != scalarCost) {
+                std::cout << ",cost mismatch " << solution.cost << " != " << scalarCost;
+                continue;
+            }
+            std::cout << "," << uint64_t(states / seconds);
+        }
+        std::cout << std::endl;
+    }
+}
+
+// compares the branch and bound solution bounded with matrix reductions to the
+// one bounded with the assignment problem on the given instances. Each run
+// stops after `expandLimit` nodes.
+void benchBnb(const std::vector<std::string>& files, long expandLimit) {
+    std::cout << "instance,bound,cost,finished,expanded,peak queued,peak memory [KiB],time [ms]" << std::endl;
+
+    for (const std::string& file : files) {
+        Tsp tsp = Tsp::loadFromFile(file);
+        const DistanceMatrix<int>& adjMatrix = tsp.getAdjMatrix();
+        int n = tsp.size();
+
+        for (BnbBound bound : {BnbBound::Reduction, BnbBound::Assignment}) {
+            BnbStats stats;
+            stats.expandLimit = expandLimit;
+            BnbOptions options;
+            options.bound = bound;
+
+            auto start = std::chrono::steady_clock::now();
+            TspSolution solution = tspBnb(adjMatrix, n, options, &stats);
+            auto end = std::chrono::steady_clock::now();
+
+            std::cout << file << "," << bnbBoundName(bound) << ","
+                << solution.cost << "," << (stats.finished ? "yes" : "no") << ","
+                << stats.expanded << "," << stats.peakQueued << "," << stats.peakBytes / 1024 << ","
+                << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+        }
+    }
+}
+
+// Measures how many generations per second the genetic algorithm goes
+// through on the given instances, and how many heap allocations it makes.
+// Each instance is solved for 1 and for `seconds` seconds: if the
+// generations don't allocate, both runs make the same number of allocations.
+// They're only counted in the bench build (see alloc_counter.cpp), and are
+// "-" in any other one.
+void benchGa(const std::vector<std::string>& files, float seconds) {
+    std::cout << "instance,time [s],generations,generations/s,allocations,cost" << std::endl;
+
+    for (const std::string& file : files) {
+        Tsp tsp = Tsp::loadFromFile(file);
+
+        for (float timeout : {1.0f, seconds}) {
+            GaTspSolver solver(tsp);
+
+            long allocationsBefore = heapAllocationCount();
+            auto start = std::chrono::steady_clock::now();
+            TspSolution solution = solver.solve(0, timeout);
+            auto end = std::chrono::steady_clock::now();
+            std::string allocations = allocationsBefore == -1 ? "-"
+                : std::to_string(heapAllocationCount() - allocationsBefore);
+
+            double elapsed = std::chrono::duration<double>(end - start).count();
+            std::cout << file << "," << timeout << "," << solver.getGenerations() << ","
+                << long(solver.getGenerations() / elapsed) << "," << allocations << ","
+                << solution.cost << std::endl;
+        }
+    }
+}
+
+// Compares the crossover operators of the genetic algorithm on the given
+// instances: each of them gets the same wall time, and the best cost found is
+// printed after 1, 3 and 10 seconds, from separate runs.
+void benchCrossover(const std::vector<std::string>& files) {
+    const GaCrossover crossovers[] = { GaCrossover::Swap, GaCrossover::Order, GaCrossover::Pmx, GaCrossover::Eax };
+
+    std::cout << "instance,crossover,time [s],generations,cost" << std::endl;
+    for (const std::string& file : files) {
+        Tsp tsp = Tsp::loadFromFile(file);
+
+        for (GaCrossover crossover : crossovers) {
+            for (float timeout : {1.0f, 3.0f, 10.0f}) {
+                GaOptions options;
+                options.crossover = crossover;
+                GaTspSolver solver(tsp, options);
+                TspSolution solution = solver.solve(0, timeout);
+                std::cout << file << "," << gaCrossoverName(crossover) << "," << timeout << ","
+                    << solver.getGenerations() << "," << solution.cost << std::endl;
+            }
+        }
+    }
+}
+
+// Measures the overhead of improving the children of the genetic algorithm
+// with local search, for a few shares of the children improved. Each run
+// takes `seconds` seconds.
+void benchMemetic(const std::vector<std::string>& files, float seconds) {
+    std::cout << "instance,share,generations,local search [ms/generation],local search [% of time],cost" << std::endl;
+
+    for (const std::string& file : files) {
+        Tsp tsp = Tsp::loadFromFile(file);
+
+        for (double share : {0.0, 0.05, 0.25, 1.0}) {
+            GaOptions options;
+            options.memeticShare = share;
+            GaTspSolver solver(tsp, options);
+            TspSolution solution = solver.solve(0, seconds);
+
+            int generations = std::max(1, solver.getGenerations());
+            std::cout << file << "," << share << "," << generations << ","
+                << solver.getLocalSearchSeconds() * 1000 / generations << ","
+                << solver.getLocalSearchSeconds() * 100 / seconds << "," << solution.cost << std::endl;
+        }
+    }
+}
+
+// Compares the parent selection methods of the genetic algorithm on
+// populations of growing size, by how many children per second they let it
+// make in runs of `seconds` seconds.
+void benchSelection(const std::vector<std::string>& files, float seconds) {
+    const GaSelection selections[] = { GaSelection::Roulette, GaSelection::Tournament };
+
+    std::cout << "instance,selection,population,generations,children/s,cost" << std::endl;
+    for (const std::string& file : files) {
+        Tsp tsp = Tsp::loadFromFile(file);
+
+        for (int populationSize : {64, 1024, 4096}) {
+            for (GaSelection selection : selections) {
+                GaOptions options;
+                options.selection = selection;
+                options.populationSize = populationSize;
+                GaTspSolver solver(tsp, options);
+
+                auto start = std::chrono::steady_clock::now();
+                TspSolution solution = solver.solve(0, seconds);
+                auto end = std::chrono::steady_clock::now();
+
+                double elapsed = std::chrono::duration<double>(end - start).count();
+                std::cout << file << "," << gaSelectionName(selection) << "," << populationSize << ","
+                    << solver.getGenerations() << "," << long(double(solver.getGenerations()) * populationSize / elapsed)
+                    << "," << solution.cost << std::endl;
+            }
+        }
+    }
+}
+
+// Measures how fast instances are loaded, on random ones of the given sizes
+// written to temporary files: a full matrix (.atsp), the same matrix in the
+// binary format (.tspbin), and the upper triangle of a symmetric one (.tsp).
+void benchLoad(const std::vector<int>& sizes) {
+    std::mt19937 gen(0);
+    std::uniform_int_distribution<> distribution(1, 999);
+    std::string directory = std::filesystem::temp_directory_path();
+
+    auto measure = [](const std::string& path, const std::string& format) {
+        double megabytes = std::filesystem::file_size(path) / 1e6;
+
+        auto start = std::chrono::steady_clock::now();
+        Tsp tsp = Tsp::loadFromFile(path);
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << tsp.size() << "," << format << "," << megabytes << "," << long(seconds * 1000)
+            << "," << long(megabytes / seconds) << std::endl;
+        return tsp;
+    };
+
+    std::cout << "N,format,file [MB],time [ms],MB/s" << std::endl;
+    for (int n : sizes) {
+        for (std::string format : {"FULL_MATRIX", "UPPER_ROW"}) {
+            std::string path = directory + "/bench-load-" + std::to_string(n)
+                + (format == "FULL_MATRIX" ? ".atsp" : ".tsp");
+            {
+                std::ofstream file(path);
+                file << "NAME: bench\nTYPE: " << (format == "FULL_MATRIX" ? "ATSP" : "TSP")
+                    << "\nDIMENSION: " << n << "\nEDGE_WEIGHT_TYPE: EXPLICIT\nEDGE_WEIGHT_FORMAT: "
+                    << format << "\nEDGE_WEIGHT_SECTION\n";
+                for (int i = 0; i < n; i++) {
+                    for (int j = format == "FULL_MATRIX" ? 0 : i + 1; j < n; j++) {
+                        file << (i == j ? 100000000 : distribution(gen)) << ' ';
+                    }
+                    file << '\n';
+                }
+                file << "EOF\n";
+            }
+            Tsp tsp = measure(path, format);
+            std::filesystem::remove(path);
+
+            if (format == "FULL_MATRIX") {
+                std::string binaryPath = directory + "/bench-load-" + std::to_string(n) + ".tspbin";
+                tsp.saveToBinary(binaryPath);
+                measure(binaryPath, "binary");
+                std::filesystem::remove(binaryPath);
+            }
+        }
+    }
+}
+
+// one line of benchWeights, for the instance loaded with weights of type `Weight`
+template <typename Weight>
+void benchWeightsOf(const std::string& file, float seconds) {
+    std::cout << file << "," << sizeof(Weight) * 8 << ",";
+    std::optional<BasicTsp<Weight>> loaded;
+    try {
+        loaded = BasicTsp<Weight>::loadFromFile(file);
+    }
+    catch (const std::runtime_error& e) {
+        std::cout << e.what() << std::endl;
+        return;
+    }
+    const BasicTsp<Weight>& tsp = *loaded;
+    const DistanceMatrix<Weight>& adjMatrix = tsp.getAdjMatrix();
+    int n = tsp.size();
+    std::cout << n * adjMatrix.stride() * sizeof(Weight) / 1024 << ",";
+
+    if (n <= 64) {
+        BnbStats stats;
+        stats.expandLimit = 200000;
+        auto start = std::chrono::steady_clock::now();
+        tspBnb(adjMatrix, n, {}, &stats);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << long(stats.expanded / std::chrono::duration<double>(end - start).count());
+    }
+    else {
+        std::cout << "-";
+    }
+
+    GaTspSolver solver(tsp);
+    solver.setSeed(0);
+    auto start = std::chrono::steady_clock::now();
+    TspSolution solution = solver.solve(0, seconds);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "," << long(solver.getGenerations() / std::chrono::duration<double>(end - start).count())
+        << "," << solution.cost << std::endl;
+}
+
+// Compares the instances loaded with 16 and with 32 bit weights, by how many
+// nodes per second the branch and bound solution bounded with matrix
+// reductions expands (on instances of up to 64 cities), and how many
+// generations per second the genetic algorithm goes through in `seconds`.
+void benchWeights(const std::vector<std::string>& files, float seconds) {
+    std::cout << "instance,weights [bit],matrix [KiB],bnb nodes/s,ga generations/s,ga cost" << std::endl;
+    for (const std::string& file : files) {
+        benchWeightsOf<int16_t>(file, seconds);
+        benchWeightsOf<int32_t>(file, seconds);
+    }
+}
+
+// Runs the heuristic solvers on random EUC_2D instances of the given sizes,
+// given by coordinates (see CoordinateTsp). Reports how long loading them and
+// building the neighbour lists from the k-d tree takes, checks the k-d tree
+// against a scan of all the cities for a few of them, and measures how many
+// moves per second simulated annealing makes and how many generations per
+// second the genetic algorithm goes through in `seconds`, with the cache of
+// distances off and on. The cities lie in a square large enough for the tours
+// of 50000 cities to cost more than fits in an int, and the costs of a few
+// random tours and of the tour of the genetic algorithm are checked against
+// the sums of their edges.
+void benchCoordinates(const std::vector<int>& sizes, float seconds) {
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<> coordinate(0, 100000);
+    std::string directory = std::filesystem::temp_directory_path();
+    const size_t CACHE_ENTRIES = size_t(1) << 14;
+    const int NEIGHBOURS = 8;
+
+    std::cout << "N,cache entries,load [ms],neighbour lists [ms],k-d tree errors,sa moves/s,ga generations/s,ga cost,"
+        "tour cost errors,peak RSS [MiB]" << std::endl;
+    for (int n : sizes) {
+        std::string path = directory + "/bench-coordinates-" + std::to_string(n) + ".tsp";
+        {
+            std::ofstream file(path);
+            file << "NAME: bench\nTYPE: TSP\nDIMENSION: " << n << "\nEDGE_WEIGHT_TYPE: EUC_2D\nNODE_COORD_SECTION\n";
+            for (int i = 0; i < n; i++) file << i + 1 << ' ' << coordinate(gen) << ' ' << coordinate(gen) << '\n';
+            file << "EOF\n";
+        }
+
+        for (size_t cacheEntries : {size_t(0), CACHE_ENTRIES}) {
+            auto start = std::chrono::steady_clock::now();
+            CoordinateTsp tsp = CoordinateTsp::loadFromTsplib(path, cacheEntries);
+            auto end = std::chrono::steady_clock::now();
+            std::cout << n << "," << cacheEntries << "," << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+            const CoordinateDistances& distances = tsp.getAdjMatrix();
+            start = std::chrono::steady_clock::now();
+            NeighbourLists neighbours(distances, n, NEIGHBOURS);
+            end = std::chrono::steady_clock::now();
+            std::cout << "," << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+            // the distances to the nearest cities have to be the smallest
+            // ones, whichever of the cities as far are picked
+            int errors = 0;
+            std::vector<int> all(n - 1);
+            for (int sample = 0; sample < 100; sample++) {
+                int city = gen() % n;
+                for (int other = 0, i = 0; other < n; other++) {
+                    if (other != city) all[i++] = distances(city, other);
+                }
+                std::partial_sort(all.begin(), all.begin() + NEIGHBOURS, all.end());
+                for (int i = 0; i < NEIGHBOURS; i++) {
+                    if (distances(city, neighbours.out[city * NEIGHBOURS + i]) != all[i]) errors++;
+                }
+            }
+            std::cout << "," << errors;
+
+            SaChain<CoordinateTsp> chain(tsp, 0, Rng(0));
+            const long STEPS = 100000;
+            long moves = 0;
+            start = std::chrono::steady_clock::now();
+            do {
+                chain.run(STEPS, 1000);
+                moves += STEPS;
+                end = std::chrono::steady_clock::now();
+            } while (std::chrono::duration<double>(end - start).count() < seconds);
+            std::cout << "," << long(moves / std::chrono::duration<double>(end - start).count());
+
+            GaTspSolver solver(tsp);
+            solver.setSeed(0);
+            start = std::chrono::steady_clock::now();
+            TspSolution solution = solver.solve(0, seconds);
+            end = std::chrono::steady_clock::now();
+            std::cout << "," << solver.getGenerations() / std::chrono::duration<double>(end - start).count()
+                << "," << solution.cost;
+
+            auto edgesSum = [&](const std::vector<int>& tour) {
+                int64_t sum = 0;
+                for (int i = 0; i < n; i++) sum += distances(tour[i], tour[(i + 1) % n]);
+                return sum;
+            };
+            int costErrors = solution.cost != edgesSum(solution.order);
+            std::vector<int> tour(n);
+            std::iota(tour.begin(), tour.end(), 0);
+            for (int sample = 0; sample < 3; sample++) {
+                std::shuffle(tour.begin() + 1, tour.end(), gen);
+                int64_t cost;
+                tsp.tourCosts(tour.data(), 1, n, true, &cost);
+                if (cost != edgesSum(tour)) costErrors++;
+            }
+            std::cout << "," << costErrors << "," << peakRssKb() / 1024 << std::endl;
+        }
+        std::filesystem::remove(path);
+    }
+}
+
+// Measures how long the candidate lists of the given instances take to build,
+// and what drawing moves from them gives the heuristics. Simulated annealing
+// makes `steps` moves while cooling down geometrically, with moves drawn from
+// the candidate lists and with uniform ones only, and the genetic algorithm
+// runs for `seconds` with and without nearest neighbour tours in its first
+// population. Costs are the mean of a few seeds.
+void benchCandidates(const std::vector<std::string>& files, long steps, float seconds) {
+    const int SEEDS = 3;
+    std::cout << "instance,candidates build [ms],sa uniform cost,sa candidate cost,sa candidate moves/s,"
+        "ga random cost,ga greedy cost" << std::endl;
+
+    for (const std::string& file : files) {
+        Tsp tsp = Tsp::loadFromFile(file);
+        tsp.candidates();
+        std::cout << file << "," << tsp.candidatesSeconds() * 1000;
+
+        double movesPerSecond = 0;
+        for (bool useCandidates : {false, true}) {
+            double cost = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int seed = 0; seed < SEEDS; seed++) {
+                SaChain<Tsp> chain(tsp, 0, Rng(seed), useCandidates);
+                const int BLOCKS = 100;
+                double t0 = chain.meanUphillDelta(1000);
+                for (int block = 0; block < BLOCKS; block++) {
+                    chain.run(steps / BLOCKS, t0 * std::pow(0.001, double(block) / BLOCKS));
+                }
+                cost += chain.bestTour().cost();
+            }
+            auto end = std::chrono::steady_clock::now();
+            movesPerSecond = SEEDS * steps / std::chrono::duration<double>(end - start).count();
+            std::cout << "," << cost / SEEDS;
+        }
+        std::cout << "," << long(movesPerSecond);
+
+        for (double greedyShare : {0.0, GaOptions{}.greedyShare}) {
+            double cost = 0;
+            for (int seed = 0; seed < SEEDS; seed++) {
+                GaOptions options;
+                options.greedyShare = greedyShare;
+                GaTspSolver solver(tsp, options);
+                solver.setSeed(seed);
+                cost += solver.solve(0, seconds).cost;
+            }
+            std::cout << "," << cost / SEEDS;
+        }
+        std::cout << std::endl;
+    }
+}
+
+// tours per second that one of the tourCosts kernels scores in batches of
+// `batch` tours from `tours`, for about a quarter of a second
+template <typename Weight>
+double benchTourCostsOf(const DistanceMatrix<Weight>& adjMatrix, const std::vector<int>& tours, size_t batch,
+        TourCostKernel kernel, ThreadPool* pool) {
+    const int n = adjMatrix.size();
+    const size_t count = tours.size() / n;
+    std::vector<int64_t> costs(batch);
+    long scored = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start;
+    do {
+        for (size_t first = 0; first + batch <= count; first += batch) {
+            tourCosts(adjMatrix, tours.data() + first * n, batch, n, true, costs.data(), pool, kernel);
+            scored += batch;
+        }
+        end = std::chrono::steady_clock::now();
+    } while (std::chrono::duration<double>(end - start).count() < 0.25);
+    return scored / std::chrono::duration<double>(end - start).count();
+}
+
+// Measures how many tours per second each of the tourCosts kernels scores on
+// random instances of the given sizes, with 16 and 32 bit weights, in batches
+// of the size of a generation of the genetic algorithm, and then with the
+// widest kernel in one large batch split between the threads of a pool.
+void benchTourCosts(const std::vector<int>& sizes) {
+    std::mt19937 gen(0);
+    const size_t GENERATION = GaOptions{}.populationSize;
+    const size_t LARGE_BATCH = 1 << 14;
+    const TourCostKernel kernels[] = { TourCostKernel::Scalar, TourCostKernel::Avx2, TourCostKernel::Avx512 };
+    ThreadPool pool(0);
+
+    std::cout << "N,weights [bit]";
+    for (TourCostKernel kernel : kernels) std::cout << "," << tourCostKernelName(kernel) << " [tours/s]";
+    std::cout << ",auto on " << pool.size() << " threads [tours/s]" << std::endl;
+
+    for (int n : sizes) {
+        std::vector<int> adjMatrix = genRandomInstance(n, gen);
+        std::vector<int> tours(LARGE_BATCH * n);
+        for (size_t t = 0; t < LARGE_BATCH; t++) {
+            std::iota(tours.begin() + t * n, tours.begin() + (t + 1) * n, 0);
+            std::shuffle(tours.begin() + t * n + 1, tours.begin() + (t + 1) * n, gen);
+        }
+
+        auto measure = [&](const auto& matrix, int bits) {
+            std::cout << n << "," << bits;
+            for (TourCostKernel kernel : kernels) {
+                bool supported = kernel == TourCostKernel::Scalar
+                    || (kernel == TourCostKernel::Avx2 && __builtin_cpu_supports("avx2"))
+                    || (kernel == TourCostKernel::Avx512 && __builtin_cpu_supports("avx512f"));
+                std::cout << ",";
+                if (supported) std::cout << long(benchTourCostsOf(matrix, tours, GENERATION, kernel, nullptr));
+                else std::cout << "-";
+            }
+            std::cout << "," << long(benchTourCostsOf(matrix, tours, LARGE_BATCH, TourCostKernel::Auto, &pool))
+                << std::endl;
+        };
+        measure(DistanceMatrix<int16_t>(adjMatrix, n), 16);
+        measure(DistanceMatrix<int32_t>(adjMatrix, n), 32);
+    }
+}
+
+// one line of the heuristics in benchSymmetry: simulated annealing cooling
+// down for `seconds`, and the memetic genetic algorithm running for as long
+template <typename Symmetry>
+void benchSymmetryHeuristics(const Tsp& tsp, float seconds) {
+    const int n = tsp.size();
+    const char* name = Symmetry::symmetric ? "symmetric" : "generic";
+
+    SaChain<Tsp, Symmetry> chain(tsp, 0, Rng(0));
+    const long STEPS = 100000;
+    const double t0 = chain.meanUphillDelta(1000);
+    long moves = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start;
+    do {
+        chain.run(STEPS, t0 * std::pow(0.001, std::chrono::duration<double>(end - start).count() / seconds));
+        moves += STEPS;
+        end = std::chrono::steady_clock::now();
+    } while (std::chrono::duration<double>(end - start).count() < seconds);
+    std::cout << n << ",sa," << name << "," << long(moves / std::chrono::duration<double>(end - start).count())
+        << "," << chain.bestTour().cost() << std::endl;
+
+    GaOptions options;
+    options.memeticShare = 0.25;
+    GaTspSolver<Tsp, Symmetry> solver(tsp, options);
+    solver.setSeed(0);
+    start = std::chrono::steady_clock::now();
+    TspSolution solution = solver.solve(0, seconds);
+    end = std::chrono::steady_clock::now();
+    std::cout << n << ",memetic ga," << name << ","
+        << long(solver.getGenerations() / std::chrono::duration<double>(end - start).count())
+        << "," << solution.cost << std::endl;
+}
+
+// Compares the solvers specialized for symmetric instances to the generic
+// ones, on random symmetric instances: points in a square, with distances
+// rounded to the nearest integer. The exact solvers are timed on instances of
+// `exactSizes` cities and have to agree on the cost, with branch and bound
+// stopped after `expandLimit` nodes. The layered dynamic programming solution
+// is given with the memory its predecessors take. Simulated annealing and the
+// memetic genetic algorithm run for `seconds` on `heuristicSize` cities, and
+// are given with their moves or generations per second.
+void benchSymmetry(const std::vector<int>& exactSizes, long expandLimit, int heuristicSize, float seconds) {
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<> coordinate(0, 1000);
+    auto euclidean = [&](int n) {
+        std::vector<double> x(n), y(n);
+        for (int i = 0; i < n; i++) {
+            x[i] = coordinate(gen);
+            y[i] = coordinate(gen);
+        }
+        std::vector<int> adjMatrix(n * n);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                adjMatrix[i * n + j] = i == j ? FORBIDDEN_EDGE : int(std::hypot(x[i] - x[j], y[i] - y[j]) + 0.5);
+            }
+        }
+        return Tsp(adjMatrix, n);
+    };
+    auto milliseconds = [](auto run) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    };
+
+    std::cout << "N,dp generic [ms],dp symmetric [ms],layered generic [ms],layered symmetric [ms],"
+        "layered predecessors generic [MiB],layered predecessors symmetric [MiB],"
+        "bnb generic nodes,bnb symmetric nodes,bnb generic [ms],bnb symmetric [ms],costs" << std::endl;
+    for (int n : exactSizes) {
+        Tsp tsp = euclidean(n);
+        const DistanceMatrix<int>& adjMatrix = tsp.getAdjMatrix();
+        std::vector<int> costs;
+        std::cout << n;
+
+        for (bool layered : {false, true}) {
+            std::cout << "," << milliseconds([&] {
+                costs.push_back((layered ? tspDpLayered(adjMatrix, n) : tspDp(adjMatrix, n)).cost);
+            });
+            std::cout << "," << milliseconds([&] {
+                costs.push_back((layered ? tspDpLayered<Symmetric>(adjMatrix, n) : tspDp<Symmetric>(adjMatrix, n)).cost);
+            });
+        }
+
+        // a predecessor is a byte, for every city of every set up to the
+        // size of the last layer
+        const int m = n - 1;
+        for (int last : {m, (m + 1) / 2}) {
+            uint64_t bytes = 0;
+            for (int k = 1; k <= last; k++) bytes += binomial(m, k) * k;
+            std::cout << "," << bytes / double(1 << 20);
+        }
+
+        BnbStats generic, symmetric;
+        generic.expandLimit = symmetric.expandLimit = expandLimit;
+        long genericMs = milliseconds([&] {
+            TspSolution solution = tspBnb(adjMatrix, n, {}, &generic);
+            if (generic.finished) costs.push_back(solution.cost);
+        });
+        long symmetricMs = milliseconds([&] {
+            TspSolution solution = tspBnb<Symmetric>(adjMatrix, n, {}, &symmetric);
+            if (symmetric.finished) costs.push_back(solution.cost);
+        });
+        std::cout << "," << generic.expanded << (generic.finished ? "" : "+")
+            << "," << symmetric.expanded << (symmetric.finished ? "" : "+")
+            << "," << genericMs << "," << symmetricMs << ","
+            << (std::count(costs.begin(), costs.end(), costs[0]) == long(costs.size()) ? "match" : "mismatch")
+            << std::endl;
+    }
+
+    std::cout << "N,solver,symmetry,moves or generations/s,cost" << std::endl;
+    Tsp tsp = euclidean(heuristicSize);
+    benchSymmetryHeuristics<Asymmetric>(tsp, seconds);
+    benchSymmetryHeuristics<Symmetric>(tsp, seconds);
+}
+
+// Compares going over the lists of allowed arcs to going over whole rows of
+// the matrix, on random instances with 10, 15 and 20% of the arcs allowed (see
+// genSparseInstance). The dynamic programming solution is timed with its dense
+// and sparse inner loops, and branch and bound, stopped after `expandLimit`
+// nodes, with and without the lists, on instances of `exactSizes` cities, and
+// they have to agree on the cost. Simulated annealing and the memetic genetic
+// algorithm run for `seconds` on `heuristicSize` cities, and their tours must
+// not take a forbidden edge.
+void benchSparse(const std::vector<int>& exactSizes, long expandLimit, int heuristicSize, float seconds) {
+    std::mt19937 gen(0);
+    const double densities[] = { 0.1, 0.15, 0.2 };
+    // the fastest of the kernels that go over whole rows
+    const DpKernel dense = __builtin_cpu_supports("avx2") ? DpKernel::Avx2 : DpKernel::Scalar;
+    auto milliseconds = [](auto run) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    };
+
+    std::cout << "N,density,dp dense [ms],dp sparse [ms],bnb nodes,bnb rows [ms],bnb arcs [ms],costs" << std::endl;
+    for (int n : exactSizes) {
+        for (double density : densities) {
+            DistanceMatrix<int> adjMatrix(genSparseInstance(n, density, gen), n);
+            adjMatrix.allowedArcs();
+            std::vector<int> costs;
+            std::cout << n << "," << density;
+
+            std::cout << "," << milliseconds([&] {
+                costs.push_back(tspDp(adjMatrix, n, 1, dense).cost);
+            });
+            std::cout << "," << milliseconds([&] {
+                costs.push_back(tspDp(adjMatrix, n, 1, DpKernel::Sparse).cost);
+            });
+
+            BnbStats rowStats, arcStats;
+            rowStats.expandLimit = arcStats.expandLimit = expandLimit;
+            BnbOptions rows, arcs;
+            rows.useArcLists = false;
+            long rowsMs = milliseconds([&] {
+                TspSolution solution = tspBnb(adjMatrix, n, rows, &rowStats);
+                if (rowStats.finished) costs.push_back(solution.cost);
+            });
+            long arcsMs = milliseconds([&] {
+                TspSolution solution = tspBnb(adjMatrix, n, arcs, &arcStats);
+                if (arcStats.finished) costs.push_back(solution.cost);
+            });
+            std::cout << "," << arcStats.expanded << (arcStats.finished ? "" : "+")
+                << "," << rowsMs << "," << arcsMs << ","
+                << (std::count(costs.begin(), costs.end(), costs[0]) == long(costs.size()) ? "match" : "mismatch")
+                << std::endl;
+        }
+    }
+
+    std::cout << "N,density,solver,cost,tour" << std::endl;
+    for (double density : densities) {
+        const int n = heuristicSize;
+        Tsp tsp(genSparseInstance(n, density, gen), n);
+        auto check = [&](const char* name, const std::vector<int>& order, int64_t cost) {
+            bool allowed = cost != INT32_MAX;
+            for (size_t i = 0; allowed && i < order.size(); i++) {
+                allowed = !tsp.getAdjMatrix().forbidden(order[i], order[(i + 1) % order.size()]);
+            }
+            std::cout << n << "," << density << "," << name << "," << cost << ","
+                << (allowed ? "allowed" : "takes a forbidden edge") << std::endl;
+        };
+
+        SaChain<Tsp> chain(tsp, 0, Rng(0));
+        const double t0 = chain.meanUphillDelta(1000);
+        auto start = std::chrono::steady_clock::now();
+        auto end = start;
+        do {
+            chain.run(100000, t0 * std::pow(0.001, std::chrono::duration<double>(end - start).count() / seconds));
+            end = std::chrono::steady_clock::now();
+        } while (std::chrono::duration<double>(end - start).count() < seconds);
+        const std::vector<int>& cities = chain.bestTour().cities();
+        check("sa", std::vector<int>(cities.begin(), cities.end() - 1), chain.bestTour().cost());
+
+        GaOptions options;
+        options.memeticShare = 0.25;
+        GaTspSolver<Tsp> solver(tsp, options);
+        solver.setSeed(0);
+        TspSolution solution = solver.solve(0, seconds);
+        check("memetic ga", solution.order, solution.cost);
+    }
+}
+
+// runs the benchmark of the given name, with the rest of the command as its
+// arguments
+void runBenchmark(const std::string& name, const std::vector<std::string>& args) {
+    if (name == "dp") {
+        benchDp(16, 23);
+    }
+    else if (name == "bnb") {
+        benchBnb(args, 200000);
+    }
+    else if (name == "ga") {
+        benchGa(args, 5);
+    }
+    else if (name == "crossover") {
+        benchCrossover(args);
+    }
+    else if (name == "memetic") {
+        benchMemetic(args, 10);
+    }
+    else if (name == "selection") {
+        benchSelection(args, 5);
+    }
+    else if (name == "weights") {
+        benchWeights(args, 5);
+    }
+    else if (name == "load") {
+        std::vector<int> sizes;
+        for (const std::string& arg : args) sizes.push_back(std::stoi(arg));
+        if (sizes.empty()) sizes = {5000, 10000};
+        benchLoad(sizes);
+    }
+    else if (name == "tourcost") {
+        std::vector<int> sizes;
+        for (const std::string& arg : args) sizes.push_back(std::stoi(arg));
+        if (sizes.empty()) sizes = {17, 47, 170, 403};
+        benchTourCosts(sizes);
+    }
+    else if (name == "candidates") {
+        benchCandidates(args, 2000000, 5);
+    }
+    else if (name == "coordinates") {
+        std::vector<int> sizes;
+        for (const std::string& arg : args) sizes.push_back(std::stoi(arg));
+        if (sizes.empty()) sizes = {20000, 50000, 100000};
+        benchCoordinates(sizes, 5);
+    }
+    else if (name == "symmetry") {
+        std::vector<int> sizes;
+        for (const std::string& arg : args) sizes.push_back(std::stoi(arg));
+        if (sizes.empty()) sizes = {12, 16, 20, 22};
+        benchSymmetry(sizes, 1000000, 1000, 5);
+    }
+    else if (name == "sparse") {
+        std::vector<int> sizes;
+        for (const std::string& arg : args) sizes.push_back(std::stoi(arg));
+        if (sizes.empty()) sizes = {16, 20, 22};
+        benchSparse(sizes, 1000000, 1000, 5);
+    }
+    else {
+        std::cout << "unknown benchmark: " << name << std::endl;
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+#include "mapped_file.cpp"
+
+// The binary instance format, which is mapped into memory and used in place,
+// so that loading an instance takes the same time however large its text
+// would be. Convert instances to it with the `convert` command.
+//
+// The file is the header below, followed by the matrix: n rows of n weights
+// of 16 or 32 bits, each padded with zeros to a multiple of BINARY_ALIGNMENT
+// bytes, so that every row starts on a cache line. Numbers are stored in the
+// byte order of the machine (little endian on x86).
+
+const char BINARY_MAGIC[8] = { 'T', 'S', 'P', 'B', 'I', 'N', '\r', '\n' };
+const uint32_t BINARY_VERSION = 1;
+const size_t BINARY_ALIGNMENT = 64;
+
+// set in `flags` when the weight of every edge is the same in both directions
+const uint32_t BINARY_SYMMETRIC = 1;
+
+struct BinaryInstanceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t n;
+    // size of a weight in bytes
+    uint32_t weightBytes;
+    uint32_t flags;
+    // bytes from the start of a row to the start of the next one
+    uint64_t rowBytes;
+    // binaryChecksum of the matrix, padding included
+    uint64_t checksum;
+    uint8_t reserved[24];
+};
+static_assert(sizeof(BinaryInstanceHeader) == BINARY_ALIGNMENT);
+
+// FNV-1a over 8 byte words instead of bytes, so it runs at memory speed.
+// `size` is a multiple of 8, as the rows are padded.
+uint64_t binaryChecksum(const uint8_t* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0x100000001b3;
+    }
+    return hash;
+}
+
+// bytes of a row of n weights of `weightBytes` bytes, with its padding
+uint64_t binaryRowBytes(uint32_t n, uint32_t weightBytes) {
+    return (uint64_t(n) * weightBytes + BINARY_ALIGNMENT - 1) / BINARY_ALIGNMENT * BINARY_ALIGNMENT;
+}
+
+// checks that `file` is a valid binary instance and returns its header.
+// Throws std::runtime_error if not.
+const BinaryInstanceHeader& readBinaryHeader(const MappedFile& file) {
+    if (file.size() < sizeof(BinaryInstanceHeader)) throw std::runtime_error("too short for a binary instance");
+
+    const BinaryInstanceHeader& header = *reinterpret_cast<const BinaryInstanceHeader*>(file.bytes());
+    if (std::memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+        throw std::runtime_error("not a binary instance");
+    }
+    if (header.version != BINARY_VERSION) {
+        throw std::runtime_error("unsupported version " + std::to_string(header.version));
+    }
+    if (header.weightBytes != sizeof(int16_t) && header.weightBytes != sizeof(int32_t)) {
+        throw std::runtime_error("unsupported weight size " + std::to_string(header.weightBytes));
+    }
+    if (header.n == 0 || header.rowBytes != binaryRowBytes(header.n, header.weightBytes)
+            || file.size() < sizeof(BinaryInstanceHeader) + header.n * header.rowBytes) {
+        throw std::runtime_error("truncated or malformed binary instance");
+    }
+    if (binaryChecksum(file.bytes() + sizeof(BinaryInstanceHeader), header.n * header.rowBytes) != header.checksum) {
+        throw std::runtime_error("checksum mismatch");
+    }
+    return header;
+}
+
+// a copy of the matrix of a valid binary instance, n x n ints without padding
+std::vector<int> binaryMatrix(const MappedFile& file) {
+    const BinaryInstanceHeader& header = *reinterpret_cast<const BinaryInstanceHeader*>(file.bytes());
+    const uint32_t n = header.n;
+    std::vector<int> adjMatrix(size_t(n) * n);
+    for (uint32_t from = 0; from < n; ++from) {
+        const uint8_t* row = file.bytes() + sizeof(BinaryInstanceHeader) + from * header.rowBytes;
+        for (uint32_t to = 0; to < n; ++to) {
+            if (header.weightBytes == sizeof(int16_t)) {
+                int16_t weight;
+                std::memcpy(&weight, row + to * sizeof(int16_t), sizeof(int16_t));
+                adjMatrix[size_t(from) * n + to] = weight;
+            }
+            else {
+                std::memcpy(&adjMatrix[size_t(from) * n + to], row + to * sizeof(int32_t), sizeof(int32_t));
+            }
+        }
+    }
+    return adjMatrix;
+}
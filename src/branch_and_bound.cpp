@@ -3,98 +3,608 @@
 #include <iostream>
 #include <cstdint>
 #include <queue>
+#include <algorithm>
+#include <cassert>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+#include <span>
+#include <numeric>
 
 #include "lib.h"
+#include "thread_pool.cpp"
+#include "assignment.cpp"
+#include "heuristic_tour.cpp"
 
-// a node used in the branch and bound solution
-// we do not keep old nodes and traverse up the tree to find a solution because
-// as far as i'm aware the priority queue doesn't let us do that, so we just
-// incorporate old nodes content into the new nodes
+// cities are bits of a set of visited cities, so the solution handles up to 64
+// cities
+using BnbSet = uint64_t;
+
+// A node used in the branch and bound solution. Nodes don't keep their own copy
+// of the reduced matrix. Since reductions only ever subtract a value from a
+// whole row or column, the reduced matrix of a node is the original matrix
+// with every element (r, c) lowered by rows[r] + columns[c], where `rows` and
+// `columns` are the sums of all the reductions on the way from the root. The
+// rows of the visited cities other than the current one, the columns of the
+// visited cities other than the start, and the edge from the current city back
+// to the start are removed from it.
+// The path is not stored either, it's read by following the parents.
 struct Node {
     int cost;
     int node;
     int parent;
     int level;
-    std::vector<int> adjMatrix;
+    BnbSet visited;
+    // the reductions of the node in the arena, -1 once they are not needed
+    int slot;
+};
+
+// A store of all the nodes created during the search. The nodes themselves are
+// small and are kept until the end, so that a path can be read from any of
+// them. The row and column reductions, 2n numbers per node, are only needed
+// until the node is expanded, after which their slot is reused for another
+// node. If `storePaths` is set, each slot also has room for the path of the
+// node, for nodes that are passed around without their parents.
+class NodeArena {
+    int n;
+    int slotSize;
+    std::vector<int> reductions;
+    std::vector<int> freeSlots;
+
+public:
+    std::vector<Node> nodes;
+
+    NodeArena(int _n, bool storePaths = false) : n(_n), slotSize(storePaths ? 3 * _n : 2 * _n) {}
+
+    int allocate() {
+        if(!freeSlots.empty()) {
+            int slot = freeSlots.back();
+            freeSlots.pop_back();
+            return slot;
+        }
+        reductions.resize(reductions.size() + slotSize);
+        return reductions.size() / slotSize - 1;
+    }
+
+    void release(int slot) {
+        freeSlots.push_back(slot);
+    }
+
+    // the reductions of the rows of the node in the given slot, followed by
+    // the reductions of its columns, and its path if the arena stores them.
+    // The pointers are valid until the next `allocate`.
+    int* rows(int slot) { return &reductions[size_t(slot) * slotSize]; }
+    int* columns(int slot) { return rows(slot) + n; }
+    int* order(int slot) { return rows(slot) + 2 * n; }
+
+    // memory taken by the nodes and the reductions
+    size_t bytes() const {
+        return nodes.capacity() * sizeof(Node) + reductions.capacity() * sizeof(int);
+    }
+
+    // the cities on the path from the root to the node, in order
+    std::vector<int> path(int node) const {
+        std::vector<int> order;
+        for(; node != -1; node = nodes[node].parent) {
+            order.push_back(nodes[node].node);
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+};
+
+// an entry of the queue of nodes waiting to be expanded, referring to a node in
+// the arena
+struct QueueEntry {
+    int cost;
+    int level;
+    int node;
+};
+
+// Counters of a branch and bound run, used to compare the bounds. The run can
+// also be limited to a number of expanded nodes, in which case the solution is
+// the best one found by then.
+struct BnbStats {
+    long expanded = 0;
+    long peakQueued = 0;
+    size_t peakBytes = 0;
+    // 0 means no limit
+    long expandLimit = 0;
+    // false if the limit was hit before the search was done
+    bool finished = true;
+
+    // records the expansion of a node, returns false if the limit is hit
+    bool expand(long queued, size_t bytes) {
+        peakQueued = std::max(peakQueued, queued);
+        peakBytes = std::max(peakBytes, bytes);
+        if(expandLimit != 0 && expanded >= expandLimit) {
+            finished = false;
+            return false;
+        }
+        ++expanded;
+        return true;
+    }
+};
+
+// how the branch and bound solution bounds the cost of the nodes
+enum class BnbBound {
+    // by the sum of the reductions of their matrices (see reduceMatrix)
+    Reduction,
+    // by the assignment problem (see tspBnbAssignment)
+    Assignment,
+};
+
+const char* bnbBoundName(BnbBound bound) {
+    switch(bound) {
+    case BnbBound::Assignment:
+        return "assignment";
+    default:
+        return "reduction";
+    }
+}
+
+// Settings of a branch and bound run.
+struct BnbOptions {
+    BnbBound bound = BnbBound::Reduction;
+
+    // Only tours cheaper than `order`, of cost `upper`, are looked for. If the
+    // order is empty, `upper` is just a bound, and tours that cost as much are
+    // still found.
+    int upper = INT32_MAX;
     std::vector<int> order;
 
-    Node(int _cost, int _node, int _parent, int _level, std::vector<int> _adjMatrix, std::vector<int> _order) :
-        cost(_cost),
-        node(_node),
-        parent(_parent),
-        level(_level),
-        adjMatrix(_adjMatrix),
-        order(_order)
-    {}
+    // Once the nodes waiting in the queue take more than `memoryBudget` bytes,
+    // or there are more than `nodeBudget` of them, no more nodes are queued.
+    // Instead, the subtrees of the queued nodes are searched depth first, in
+    // the order of their bounds, which only needs memory for one path of the
+    // tree at a time. 0 means no limit.
+    size_t nodeBudget = 0;
+    size_t memoryBudget = 0;
+
+    // whether to go over the lists of allowed arcs of a sparse instance (see
+    // AllowedArcs) instead of whole rows and columns of the matrix, with the
+    // reduction bound
+    bool useArcLists = true;
 };
 
-// reduce the matrix so that each row and column has at least one '0' or has no
-// valid elements (consists of all '-1's)
-int reduceMatrix(std::vector<int>& adjMatrix, int n) {
+// options that start the search from the tour found by `heuristicTour`, and
+// switch to depth first search after taking `memoryBudget` bytes
+template <typename Weight>
+BnbOptions heuristicBnbOptions(const DistanceMatrix<Weight>& adjMatrix, int n, size_t memoryBudget = 0) {
+    TspSolution tour = heuristicTour(adjMatrix, n);
+    BnbOptions options;
+    if(tour.cost != INT32_MAX) {
+        options.upper = tour.cost;
+        options.order = tour.order;
+    }
+    options.memoryBudget = memoryBudget;
+    return options;
+}
+
+// the order of the queue: expand nodes that have smalles costs first, if the
+// cost is equal, prioritise deeper nodes
+struct ExpandFirst {
+    template <typename T>
+    bool operator()(const T& lhs, const T& rhs) const {
+        return (lhs.cost > rhs.cost) || ((lhs.cost == rhs.cost) && (lhs.level < rhs.level));
+    }
+};
+
+// Reduces the matrix of a node, so that each row and column has at least one
+// '0' or has no valid elements. The matrix is given by the original one,
+// `rows` and `columns` reductions done so far, the removed rows and columns,
+// and the removed edge from `last` back to the start city; forbidden edges of
+// the original matrix are never valid. The new reductions are written to
+// `newRows` and `newColumns`, and the sum of them is returned. Given the lists
+// of allowed `arcs`, only the entries on them are looked at.
+template <typename Weight>
+int reduceMatrix(const DistanceMatrix<Weight>& adjMatrix, int n, BnbSet removedRows, BnbSet removedColumns,
+        int last, const int* rows, const int* columns, int* newRows, int* newColumns,
+        const AllowedArcs* arcs = nullptr) {
     int reductionsTotal = 0;
-    std::vector<int> rowMinimums(n, INT32_MAX);
+    // columns are scanned as the rows of the transposed matrix, which are
+    // contiguous in memory
+    const DistanceMatrix<Weight>& transposed = adjMatrix.transposed();
+
+    auto allowed = [&](int r, int c, int weight) {
+        return (removedColumns & (BnbSet(1) << c)) == 0
+            && weight != FORBIDDEN_EDGE
+            && r != c
+            && !(r == last && c == 0);
+    };
+
+    for(int r = 0; r < n; ++r) {
+        newRows[r] = rows[r];
+        if(removedRows & (BnbSet(1) << r)) continue;
 
-    for(int i = 0; i < n; ++i) {
-        for(int j = 0; j < n; ++j) {
-            if(adjMatrix[index(i, j, n)] != -1 && adjMatrix[index(i, j, n)] < rowMinimums[i]) {
-                rowMinimums.at(i) = adjMatrix[index(i, j, n)];
+        const Weight* row = adjMatrix.row(r);
+        int rowMinimum = INT32_MAX;
+        auto scan = [&](int c) {
+            if(allowed(r, c, row[c])) {
+                rowMinimum = std::min(rowMinimum, row[c] - rows[r] - columns[c]);
             }
+        };
+        if(arcs) {
+            for(int c : arcs->out(r)) scan(c);
+        }
+        else {
+            for(int c = 0; c < n; ++c) scan(c);
+        }
+        if(rowMinimum != INT32_MAX) {
+            newRows[r] += rowMinimum;
+            reductionsTotal += rowMinimum;
         }
     }
 
-    for(int i = 0; i < n; ++i) {
-        if(rowMinimums[i] != INT32_MAX) reductionsTotal += rowMinimums[i];
-        for(int j = 0; j < n; ++j) {
-            if(adjMatrix[index(i, j, n)] != -1 && rowMinimums[i] != INT32_MAX) {
-                adjMatrix.at(index(i, j, n)) -= rowMinimums[i];
+    for(int c = 0; c < n; ++c) {
+        newColumns[c] = columns[c];
+        if(removedColumns & (BnbSet(1) << c)) continue;
+
+        const Weight* column = transposed.row(c);
+        int columnMinimum = INT32_MAX;
+        auto scan = [&](int r) {
+            if(!(removedRows & (BnbSet(1) << r)) && allowed(r, c, column[r])) {
+                columnMinimum = std::min(columnMinimum, column[r] - newRows[r] - columns[c]);
             }
+        };
+        if(arcs) {
+            for(int r : arcs->in(c)) scan(r);
+        }
+        else {
+            for(int r = 0; r < n; ++r) scan(r);
+        }
+        if(columnMinimum != INT32_MAX) {
+            newColumns[c] += columnMinimum;
+            reductionsTotal += columnMinimum;
         }
     }
 
-    std::vector<int> columnMinimums(n, INT32_MAX);
+    return reductionsTotal;
+}
+
+// The lists of allowed arcs of the instance, if they're built and the solver
+// is to use them, or nullptr. `everyCity` is what a city without a list goes
+// over instead: all the cities, which the solver checks itself.
+template <typename Weight>
+const AllowedArcs* bnbArcs(const DistanceMatrix<Weight>& adjMatrix, bool useArcLists, std::vector<int>& everyCity) {
+    everyCity.resize(adjMatrix.size());
+    std::iota(everyCity.begin(), everyCity.end(), 0);
+    const AllowedArcs& arcs = adjMatrix.allowedArcs();
+    return useArcLists && arcs.listed ? &arcs : nullptr;
+}
+
+// Whether going to j from a node at `level` completes a tour that goes back
+// to the start along a forbidden edge. The reductions only account for that
+// edge when it's allowed, so such a child has to be left out.
+template <typename Weight>
+bool closesForbidden(const DistanceMatrix<Weight>& adjMatrix, int n, int level, int j) {
+    return level == n - 2 && adjMatrix.forbidden(j, 0);
+}
+
+// On a symmetric instance every tour costs the same as its reverse, so it's
+// enough to search the tours that visit city 1 before city 2. Going to city 2
+// first is left out of the tree, which cuts it in about half.
+template <typename Symmetry>
+bool mirroredChild(BnbSet visited, int j) {
+    if constexpr(Symmetry::symmetric) return j == 2 && !(visited & (BnbSet(1) << 1));
+    else return false;
+}
+
+// A node of the branch and bound solution bounded by the assignment problem.
+// It holds the edges the tours in its subtree have to use, and the ones they
+// may not use, together with the optimal assignment under those constraints.
+struct ApNode {
+    int cost;
+    int level;
+    Assignment assignment;
+    std::vector<std::pair<int, int>> included;
+    std::vector<std::pair<int, int>> excluded;
+    // whether the reverse of every tour in the subtree is in it as well
+    bool mirrored;
+};
+
+// Finds the branch and bound solution, bounding the cost of the nodes with the
+// assignment problem: the cheapest way to pick one outgoing and one incoming
+// edge for every city. On asymmetric instances that is much tighter than the
+// sum of the matrix reductions.
+// If the optimal assignment of a node is a single cycle, it's a tour. If not,
+// the node is split on the subtour with the fewest edges that are not already
+// included (Carpaneto and Toth): with those edges e_1 .. e_r, the h-th child
+// excludes e_h and includes e_1 .. e_{h-1}, so no tour is in two children and
+// none of the children contains the subtour. A child's assignment only lost
+// the edge it excludes, so it is repaired from the parent's one in O(n^2).
+// With the Symmetric tag, the first child of a node whose subtree holds the
+// reverse of each of its tours also excludes the reverse of e_1: a tour that
+// uses it is mirrored by one in another child, at the same cost. That child's
+// subtree is closed under reversal too, so the cut goes on down the tree, and
+// it takes both edges of a 2-city subtour, which the assignments of symmetric
+// instances are full of, out of the first child instead of just one.
+// The search starts from the tour or bound in `options`, like tspBnb does.
+template <typename Symmetry = Asymmetric, typename Weight>
+TspSolution tspBnbAssignment(const DistanceMatrix<Weight>& adjMatrix, int n, const BnbOptions& options = {},
+        BnbStats* stats = nullptr) {
+    // a bound without a tour has to let a tour of that cost through
+    int upper = options.upper;
+    if(options.order.empty() && upper != INT32_MAX) ++upper;
+    std::vector<int> bestSuccessor;
+
+    // the costs of the node, edges into the same city and -1s are never valid
+    std::vector<int64_t> costs(n * n);
+    std::vector<int> includedTo(n);
+    std::vector<int> includedFrom(n);
+    auto prepareCosts = [&](const ApNode& node) {
+        std::fill(includedTo.begin(), includedTo.end(), -1);
+        std::fill(includedFrom.begin(), includedFrom.end(), -1);
+        for(auto [from, to]: node.included) {
+            includedTo[from] = to;
+            includedFrom[to] = from;
+        }
+        for(int i = 0; i < n; ++i) {
+            for(int j = 0; j < n; ++j) {
+                bool forbidden = adjMatrix.forbidden(i, j)
+                    || (includedTo[i] != -1 && includedTo[i] != j)
+                    || (includedFrom[j] != -1 && includedFrom[j] != i);
+                costs[index(i, j, n)] = forbidden ? AP_FORBIDDEN : adjMatrix(i, j);
+            }
+        }
+        for(auto [from, to]: node.excluded) {
+            costs[index(from, to, n)] = AP_FORBIDDEN;
+        }
+    };
+    auto cost = [&](int i, int j) { return costs[index(i, j, n)]; };
+
+    auto assignmentCost = [&](const Assignment& assignment) {
+        int64_t sum = 0;
+        std::vector<int> successor = assignment.successors();
+        for(int i = 0; i < n; ++i) sum += cost(i, successor[i]);
+        return sum;
+    };
+
+    // the nodes waiting to be expanded, moved out of here when they are
+    std::vector<ApNode> nodes;
+    std::vector<int> freeNodes;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, ExpandFirst> tree;
+    size_t nodeBytes = 0;
 
-    for(int i = 0; i < n; ++i) {
-        for(int j = 0; j < n; ++j) {
-            if(adjMatrix[index(j, i, n)] != -1 && adjMatrix[index(j, i, n)] < columnMinimums[i])
-                columnMinimums.at(i) = adjMatrix[index(j, i, n)];
+    auto push = [&](ApNode&& node) {
+        nodeBytes += (3 * (n + 1) + 2 * (node.included.size() + node.excluded.size())) * sizeof(int64_t);
+        int id;
+        if(!freeNodes.empty()) {
+            id = freeNodes.back();
+            freeNodes.pop_back();
+            nodes[id] = std::move(node);
+        }
+        else {
+            id = nodes.size();
+            nodes.push_back(std::move(node));
+        }
+        tree.push(QueueEntry{nodes[id].cost, nodes[id].level, id});
+    };
+
+    // the root node has no constraints
+    {
+        ApNode root{0, 0, Assignment(n), {}, {}, Symmetry::symmetric && n >= 3};
+        prepareCosts(root);
+        bool feasible = true;
+        for(int i = 0; i < n && feasible; ++i) {
+            feasible = root.assignment.insert(i, cost);
+        }
+        if(feasible) {
+            root.cost = assignmentCost(root.assignment);
+            push(std::move(root));
         }
     }
 
-    for(int i = 0; i < n; ++i) {
-        if(columnMinimums[i] != INT32_MAX) reductionsTotal += columnMinimums[i];
-        for(int j = 0; j < n; ++j) {
-            if(adjMatrix[index(j, i, n)] != -1 && columnMinimums[i] != INT32_MAX)
-                adjMatrix.at(index(j, i, n)) -= columnMinimums[i];
+    std::vector<bool> seen(n);
+    while(!tree.empty()) {
+        QueueEntry entry = tree.top();
+        tree.pop();
+        ApNode node = std::move(nodes[entry.node]);
+        freeNodes.push_back(entry.node);
+        nodeBytes -= (3 * (n + 1) + 2 * (node.included.size() + node.excluded.size())) * sizeof(int64_t);
+
+        // the cheapest node left can't be better than the best tour
+        if(node.cost >= upper) {
+            break;
+        }
+
+        if(stats && !stats->expand(tree.size() + 1, nodeBytes + nodes.capacity() * sizeof(ApNode))) {
+            break;
+        }
+
+        // split the assignment into cycles, and pick the one with the fewest
+        // edges that the node is free to exclude
+        std::vector<int> successor = node.assignment.successors();
+        std::fill(seen.begin(), seen.end(), false);
+        std::vector<std::pair<int, int>> branchEdges;
+        bool tour = false;
+        prepareCosts(node);
+
+        for(int first = 0; first < n; ++first) {
+            if(seen[first]) continue;
+
+            std::vector<std::pair<int, int>> freeEdges;
+            int length = 0;
+            for(int city = first; !seen[city]; city = successor[city]) {
+                seen[city] = true;
+                ++length;
+                if(includedTo[city] == -1) freeEdges.emplace_back(city, successor[city]);
+            }
+
+            if(length == n) {
+                tour = true;
+                break;
+            }
+            if(branchEdges.empty() || freeEdges.size() < branchEdges.size()) {
+                branchEdges = std::move(freeEdges);
+            }
+        }
+
+        // if the assignment is a single cycle, it's the best tour of the
+        // subtree
+        if(tour) {
+            upper = node.cost;
+            bestSuccessor = successor;
+            continue;
+        }
+
+        for(size_t h = 0; h < branchEdges.size(); ++h) {
+            ApNode child{0, node.level + 1, node.assignment, node.included, node.excluded,
+                node.mirrored && h == 0};
+            auto [from, to] = branchEdges[h];
+            child.excluded.push_back(branchEdges[h]);
+            if(child.mirrored) child.excluded.emplace_back(to, from);
+            for(size_t e = 0; e < h; ++e) {
+                child.included.push_back(branchEdges[e]);
+            }
+
+            // the duals of the parent stay feasible, as the costs only grew,
+            // so only the rows that lost their edges have to be assigned again
+            prepareCosts(child);
+            child.assignment.unassign(from);
+            bool reverse = child.mirrored && successor[to] == from;
+            if(reverse) child.assignment.unassign(to);
+            if(!child.assignment.insert(from, cost)) continue;
+            if(reverse && !child.assignment.insert(to, cost)) continue;
+
+            int64_t bound = assignmentCost(child.assignment);
+            if(bound >= upper) continue;
+            child.cost = bound;
+            push(std::move(child));
         }
     }
 
-    return reductionsTotal;
+    // nothing cheaper than the given tour or bound was found
+    if(bestSuccessor.empty()) {
+        if(options.order.empty()) return TspSolution{{0, 0}, INT32_MAX};
+        std::vector<int> order = options.order;
+        if(order.size() == size_t(n)) order.push_back(0);
+        return TspSolution{order, upper};
+    }
+
+    // turn the successors into a path from city 0
+    std::vector<int> order;
+    int city = 0;
+    do {
+        order.push_back(city);
+        city = bestSuccessor[city];
+    } while(city != 0);
+    order.push_back(0);
+
+    return TspSolution{order, upper};
 }
 
-// Finds the branch and bound solution
-TspSolution tspBnb(const std::vector<int>& adjMatrix, int n) {
-    int upper = INT32_MAX;
+// Finds the branch and bound solution, bounding the cost of the nodes by
+// reducing their matrices, or by the assignment problem if the options ask
+// for it (see tspBnbAssignment). With the Symmetric tag, only one direction of
+// every tour is searched (see mirroredChild). On a sparse instance, a node
+// only has children along the allowed arcs of its city.
+template <typename Symmetry = Asymmetric, typename Weight>
+TspSolution tspBnb(const DistanceMatrix<Weight>& adjMatrix, int n, const BnbOptions& options = {},
+        BnbStats* stats = nullptr) {
+    assert(n <= 64);
+    if(options.bound == BnbBound::Assignment) {
+        return tspBnbAssignment<Symmetry>(adjMatrix, n, options, stats);
+    }
+
+    // a bound without a tour has to let a tour of that cost through
+    int upper = options.upper;
+    if(options.order.empty() && upper != INT32_MAX) ++upper;
+    std::vector<int> order = options.order;
+
+    NodeArena arena(n);
+    std::vector<int> everyCity;
+    const AllowedArcs* arcs = bnbArcs(adjMatrix, options.useArcLists, everyCity);
 
     // we initialize the components of a root node
-    std::vector<int> reducedMatrix(adjMatrix);
-    std::vector<int> order;
-    int reduction = reduceMatrix(reducedMatrix, n);
+    std::vector<int> zeros(n, 0);
+    int rootSlot = arena.allocate();
+    int reduction = reduceMatrix(adjMatrix, n, 0, 0, 0, zeros.data(), zeros.data(),
+        arena.rows(rootSlot), arena.columns(rootSlot), arcs);
 
-    // https://stackoverflow.com/questions/41053232/c-stdpriority-queue-uses-the-lambda-expression
-    std::priority_queue<Node, std::vector<Node>,
-        decltype([](Node& lhs, Node& rhs) {
-            // expand nodes that have smalles costs first, if the cost is equal,
-            // prioritise deeper nodes
-            return (lhs.cost > rhs.cost) || ((lhs.cost == rhs.cost) && (lhs.level < rhs.level));
-        }
-    )> tree;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, ExpandFirst> tree;
 
     // -1 means lack of parent
-    tree.emplace(reduction, 0, -1, 0, reducedMatrix, std::vector<int>{0});
+    arena.nodes.push_back(Node{reduction, 0, -1, 0, 1, rootSlot});
+    tree.push(QueueEntry{reduction, 0, 0});
 
-    while(!tree.empty()) {
-        Node node = tree.top();
+    // reductions of the node being expanded
+    std::vector<int> rows(n);
+    std::vector<int> columns(n);
+
+    // set once the budget is used up
+    bool depthFirst = false;
+    bool stopped = false;
+
+    // the path of the node being searched depth first, and the reductions of
+    // its children, n of them on every level
+    std::vector<int> path;
+    std::vector<int> childRows(size_t(n) * n * n);
+    std::vector<int> childColumns(size_t(n) * n * n);
+    std::vector<std::pair<int, int>> children(n * n);
+
+    // searches the subtree of the node at the end of `path` depth first,
+    // visiting the cheaper children first. `nodeRows` and `nodeColumns` are the
+    // reductions of the node.
+    auto searchDepthFirst = [&](auto& self, int cost, BnbSet visited,
+            const int* nodeRows, const int* nodeColumns) -> void {
+        int level = path.size() - 1;
+        int i = path.back();
+
+        if(level == n - 1) {
+            if(cost < upper) {
+                upper = cost;
+                order = path;
+            }
+            return;
+        }
+
+        if(stopped || (stats && !stats->expand(tree.size() + 1, arena.bytes() + tree.size() * sizeof(QueueEntry)))) {
+            stopped = true;
+            return;
+        }
+
+        BnbSet removedRows = visited & ~(BnbSet(1) << i);
+        BnbSet removedColumns = visited & ~BnbSet(1);
+
+        // this level's part of the buffers
+        int* levelRows = &childRows[size_t(level) * n * n];
+        int* levelColumns = &childColumns[size_t(level) * n * n];
+        std::pair<int, int>* levelChildren = &children[size_t(level) * n];
+        int count = 0;
+
+        for(int j : arcs ? arcs->out(i) : std::span<const int>(everyCity)) {
+            if((removedColumns & (BnbSet(1) << j)) || adjMatrix.forbidden(i, j) || j == 0
+                    || mirroredChild<Symmetry>(visited, j)
+                    || closesForbidden(adjMatrix, n, level, j)) {
+                continue;
+            }
+
+            int reduction = reduceMatrix(adjMatrix, n, removedRows | (BnbSet(1) << i),
+                removedColumns | (BnbSet(1) << j), j, nodeRows, nodeColumns,
+                levelRows + j * n, levelColumns + j * n, arcs);
+            int childCost = adjMatrix(i, j) - nodeRows[i] - nodeColumns[j] + cost + reduction;
+            if(childCost < upper) levelChildren[count++] = {childCost, j};
+        }
+
+        std::sort(levelChildren, levelChildren + count);
+        for(int c = 0; c < count; ++c) {
+            auto [childCost, j] = levelChildren[c];
+            // the bound may have improved in the previous subtrees
+            if(childCost >= upper) break;
+
+            path.push_back(j);
+            self(self, childCost, visited | (BnbSet(1) << j), levelRows + j * n, levelColumns + j * n);
+            path.pop_back();
+        }
+    };
+
+    while(!tree.empty() && !stopped) {
+        QueueEntry entry = tree.top();
         tree.pop();
+        Node node = arena.nodes[entry.node];
         int i = node.node;
 
         // cost estimate of next-shortest path is greater than one of our
@@ -107,38 +617,243 @@ TspSolution tspBnb(const std::vector<int>& adjMatrix, int n) {
         // solution if cost is smaller than previous one
         if(node.level == n - 1 && node.cost < upper) {
             upper = node.cost;
-            order = node.order;
+            order = arena.path(entry.node);
+        }
+
+        // the children only need the reductions of the node, so its slot can
+        // be given to the first one of them
+        std::copy_n(arena.rows(node.slot), n, rows.begin());
+        std::copy_n(arena.columns(node.slot), n, columns.begin());
+        arena.release(node.slot);
+        arena.nodes[entry.node].slot = -1;
+
+        if(depthFirst) {
+            path = arena.path(entry.node);
+            searchDepthFirst(searchDepthFirst, node.cost, node.visited, rows.data(), columns.data());
+            continue;
+        }
+
+        if(stats && !stats->expand(tree.size() + 1, arena.bytes() + tree.size() * sizeof(QueueEntry))) {
+            break;
         }
 
+        BnbSet removedRows = node.visited & ~(BnbSet(1) << i);
+        BnbSet removedColumns = node.visited & ~BnbSet(1);
+
         // expand level at that node, depth first fashion
-        for(int j = 0; j < n; ++j) {
-            if(node.adjMatrix[index(i, j, n)] == -1) {
+        for(int j : arcs ? arcs->out(i) : std::span<const int>(everyCity)) {
+            if((removedColumns & (BnbSet(1) << j)) || adjMatrix.forbidden(i, j) || j == 0
+                    || mirroredChild<Symmetry>(node.visited, j)
+                    || closesForbidden(adjMatrix, n, node.level, j)) {
                 continue;
             }
 
-            // prepare a matrix with excluded row i, column j, and ji
-            std::vector<int> newMatrix(node.adjMatrix);
-            for(int k = 0; k < n; ++k) {
-                newMatrix.at(index(i, k, n)) = -1;
-                newMatrix.at(index(k, j, n)) = -1;
-            }
-            newMatrix.at(index(j, 0, n)) = -1;
-
-            // reduce it
-            int reduction = reduceMatrix(newMatrix, n);
+            // the child matrix excludes row i, column j, and ji
+            int slot = arena.allocate();
+            int reduction = reduceMatrix(adjMatrix, n, removedRows | (BnbSet(1) << i),
+                removedColumns | (BnbSet(1) << j), j, rows.data(), columns.data(),
+                arena.rows(slot), arena.columns(slot), arcs);
 
             // cost of new node:
             // distance on the parent matrix + parent cost + child reduction
-            int cost = node.adjMatrix[index(i, j, n)] + node.cost + reduction;
+            int cost = adjMatrix(i, j) - rows[i] - columns[j] + node.cost + reduction;
 
-            std::vector<int> currentOrder(node.order);
-            currentOrder.push_back(j);
+            // a child no cheaper than a complete solution would never be
+            // expanded, so don't keep it
+            if(cost >= upper) {
+                arena.release(slot);
+                continue;
+            }
 
             // put it in the tree
-            tree.emplace(cost, j, i, node.level + 1, newMatrix, currentOrder);
+            int child = arena.nodes.size();
+            arena.nodes.push_back(Node{cost, j, entry.node, node.level + 1,
+                node.visited | (BnbSet(1) << j), slot});
+            tree.push(QueueEntry{cost, node.level + 1, child});
         }
+
+        size_t queueBytes = arena.bytes() + tree.size() * sizeof(QueueEntry);
+        depthFirst = (options.nodeBudget != 0 && tree.size() >= options.nodeBudget)
+            || (options.memoryBudget != 0 && queueBytes >= options.memoryBudget);
     }
-    order.push_back(0);
+
+    // nothing cheaper than the given tour or bound was found
+    if(order.empty()) {
+        return TspSolution{{0, 0}, INT32_MAX};
+    }
+    if(order.size() == size_t(n)) order.push_back(0);
 
     return TspSolution{order, upper};
 }
+
+// Finds the branch and bound solution using `threads` threads (0 means all
+// hardware threads). Every thread expands the nodes of its own queue, best
+// first, and when it runs out of them it takes the best node of another
+// thread's queue. The cost of the best solution found so far is shared through
+// an atomic, so all threads prune with it as soon as it improves.
+// As the queues are only ordered locally, the first complete solution is not
+// necessarily the best one, so the search ends when all the queues are empty
+// and no thread is expanding a node. Until then, threads that find no node to
+// take sleep until another thread queues some.
+template <typename Symmetry = Asymmetric, typename Weight>
+TspSolution tspBnbParallel(const DistanceMatrix<Weight>& adjMatrix, int n, int threads) {
+    assert(n <= 64);
+    ThreadPool pool(threads);
+
+    // the nodes of a worker carry their path in their arena slot, so that
+    // other workers can take them over
+    struct Worker {
+        std::mutex mutex;
+        NodeArena arena;
+        std::priority_queue<Node, std::vector<Node>, ExpandFirst> queue;
+
+        Worker(int n) : arena(n, true) {}
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+    for(int i = 0; i < pool.size(); ++i) {
+        workers.push_back(std::make_unique<Worker>(n));
+    }
+
+    std::atomic<int> upper{INT32_MAX};
+    std::mutex bestMutex;
+    std::vector<int> bestOrder;
+
+    // nodes that are queued or being expanded, the search is done at 0
+    std::atomic<long> pending{0};
+
+    // Threads without a node wait on `work`, which is notified when the search
+    // is done, or when nodes are queued while some thread waits. `pushes`
+    // counts the expansions that queued nodes, so that a thread can tell that
+    // some were queued after it looked at the queues.
+    std::mutex idleMutex;
+    std::condition_variable work;
+    std::atomic<long> pushes{0};
+    std::atomic<int> idle{0};
+
+    // marks a node as done, waking the waiting threads up if it was the last
+    auto done = [&] {
+        if(--pending == 0) {
+            std::lock_guard lock(idleMutex);
+            work.notify_all();
+        }
+    };
+
+    std::vector<int> everyCity;
+    const AllowedArcs* arcs = bnbArcs(adjMatrix, true, everyCity);
+
+    // we initialize the components of a root node
+    {
+        Worker& first = *workers[0];
+        std::vector<int> zeros(n, 0);
+        int slot = first.arena.allocate();
+        int reduction = reduceMatrix(adjMatrix, n, 0, 0, 0, zeros.data(), zeros.data(),
+            first.arena.rows(slot), first.arena.columns(slot), arcs);
+        first.arena.order(slot)[0] = 0;
+        first.queue.push(Node{reduction, 0, -1, 0, 1, slot});
+        pending = 1;
+    }
+
+    pool.parallelFor(workers.size(), [&](size_t id) {
+        // the node being expanded, with its reductions and path
+        Node node{};
+        std::vector<int> rows(n);
+        std::vector<int> columns(n);
+        std::vector<int> order(n);
+        std::vector<int> childRows(n);
+        std::vector<int> childColumns(n);
+
+        // takes the best node of the worker, copying its slot out
+        auto take = [&](Worker& worker) {
+            std::lock_guard lock(worker.mutex);
+            if(worker.queue.empty()) return false;
+
+            node = worker.queue.top();
+            worker.queue.pop();
+            std::copy_n(worker.arena.rows(node.slot), n, rows.begin());
+            std::copy_n(worker.arena.columns(node.slot), n, columns.begin());
+            std::copy_n(worker.arena.order(node.slot), node.level + 1, order.begin());
+            worker.arena.release(node.slot);
+            return true;
+        };
+
+        Worker& own = *workers[id];
+        while(true) {
+            long seen = pushes;
+            bool found = take(own);
+            for(size_t v = 1; !found && v < workers.size(); ++v) {
+                found = take(*workers[(id + v) % workers.size()]);
+            }
+            if(!found) {
+                std::unique_lock lock(idleMutex);
+                ++idle;
+                work.wait(lock, [&] { return pending == 0 || pushes != seen; });
+                --idle;
+                if(pending == 0) return;
+                continue;
+            }
+
+            int i = node.node;
+            if(node.cost >= upper.load(std::memory_order_relaxed)) {
+                done();
+                continue;
+            }
+
+            // if level = n - 1, then we reached the leaf node, update the
+            // best solution if cost is smaller than the previous one
+            if(node.level == n - 1) {
+                std::lock_guard lock(bestMutex);
+                if(node.cost < upper) {
+                    upper = node.cost;
+                    bestOrder.assign(order.begin(), order.begin() + n);
+                }
+            }
+
+            BnbSet removedRows = node.visited & ~(BnbSet(1) << i);
+            BnbSet removedColumns = node.visited & ~BnbSet(1);
+            bool pushed = false;
+
+            for(int j : arcs ? arcs->out(i) : std::span<const int>(everyCity)) {
+                if((removedColumns & (BnbSet(1) << j)) || adjMatrix.forbidden(i, j) || j == 0
+                        || mirroredChild<Symmetry>(node.visited, j)
+                        || closesForbidden(adjMatrix, n, node.level, j)) {
+                    continue;
+                }
+
+                int reduction = reduceMatrix(adjMatrix, n, removedRows | (BnbSet(1) << i),
+                    removedColumns | (BnbSet(1) << j), j, rows.data(), columns.data(),
+                    childRows.data(), childColumns.data(), arcs);
+                int cost = adjMatrix(i, j) - rows[i] - columns[j] + node.cost + reduction;
+                if(cost >= upper.load(std::memory_order_relaxed)) continue;
+
+                ++pending;
+                std::lock_guard lock(own.mutex);
+                int slot = own.arena.allocate();
+                std::copy(childRows.begin(), childRows.end(), own.arena.rows(slot));
+                std::copy(childColumns.begin(), childColumns.end(), own.arena.columns(slot));
+                int* childOrder = own.arena.order(slot);
+                std::copy_n(order.begin(), node.level + 1, childOrder);
+                childOrder[node.level + 1] = j;
+                own.queue.push(Node{cost, j, -1, node.level + 1, node.visited | (BnbSet(1) << j), slot});
+                pushed = true;
+            }
+
+            // the waiting threads see the new count either when they check it
+            // before waiting, or when they're notified
+            if(pushed) {
+                ++pushes;
+                if(idle > 0) {
+                    std::lock_guard lock(idleMutex);
+                    work.notify_all();
+                }
+            }
+            done();
+        }
+    });
+
+    // no tour goes around the forbidden edges
+    if(bestOrder.empty()) {
+        return TspSolution{{0, 0}, INT32_MAX};
+    }
+    bestOrder.push_back(0);
+    return TspSolution{bestOrder, upper};
+}
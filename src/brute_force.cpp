@@ -2,35 +2,40 @@
 
 #include <vector>
 #include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 
 #include "lib.h"
-
-// The function calculates the distance of the path for a given adjecency matrix
-int cycleDistance(const std::vector<int>& adjMatrix, int n, const std::vector<int>& order) {
-    int sum = 0;
-    size_t prevCity = order[0];
-    for (size_t i = 1; i < order.size(); ++i) {
-        sum += adjMatrix[index(prevCity, order[i], n)];
-        prevCity = order[i];
-    }
-    return sum;
-}
+#include "thread_pool.cpp"
+#include "heuristic_tour.cpp"
 
 // Calculates and returns a solution using the brute force method.
-// The path starts from city 0
-TspSolution tspBruteforce(const std::vector<int>& adjMatrix, int n) {
+// The path starts from city 0. Orders that take a forbidden edge are skipped,
+// and if all of them do, the cost is INT32_MAX.
+template <typename Weight>
+TspSolution tspBruteforce(const DistanceMatrix<Weight>& adjMatrix, int n) {
     std::vector<int> order;
     for(int i = 0; i < n; ++i) {
         order.push_back(i);
     }
-    int currentMinimum = INT32_MAX;
+    int64_t currentMinimum = INT32_MAX;
     std::vector<int> currentMinimumOrder = order;
 
+    const bool forbidding = adjMatrix.allowedArcs().count < int64_t(n) * (n - 1);
+    auto isTour = [&] {
+        for(int i = 0; i < n; ++i) {
+            if(adjMatrix.forbidden(order[i], order[(i + 1) % n])) return false;
+        }
+        return true;
+    };
+
     bool next = false;
     do {
-        int cost = cycleDistance(adjMatrix, n, order);
+        int64_t cost;
+        tourCosts(adjMatrix, order.data(), 1, n, true, &cost);
         // if current path is smaller than the minimum, update the minimum
-        if(cost < currentMinimum) {
+        if(cost < currentMinimum && (!forbidding || isTour())) {
             currentMinimum = cost;
             currentMinimumOrder = order;
         }
@@ -45,10 +50,164 @@ TspSolution tspBruteforce(const std::vector<int>& adjMatrix, int n) {
     }
     while(next && order[0] == 0);
 
-    int i = currentMinimumOrder.back();
     currentMinimumOrder.push_back(0);
-    currentMinimum += adjMatrix[index(i, 0, n)];
 
     TspSolution tsp{currentMinimumOrder, currentMinimum};
     return tsp;
-}
\ No newline at end of file
+}
+
+// Calculates a solution by trying all the tours starting from city 0, like
+// `tspBruteforce`, but built city by city with a depth first search that keeps
+// the cost of the path so far. A path is abandoned once that cost, plus the
+// cheapest edge leaving each city it still has to leave, is more than the best
+// tour found. Searching starts from a heuristic tour, and goes to the nearest
+// cities first, so that the bound is good early on.
+// The paths of the first two cities after the start are searched by `threads`
+// threads (0 means all hardware threads), sharing the best cost.
+// If `optimalTours` is given, it's set to the number of tours of the optimal
+// cost, which needs paths as expensive as the best tour to be searched as well.
+template <typename Weight>
+TspSolution tspBruteforceDfs(const DistanceMatrix<Weight>& adjMatrix, int n, int threads = 1,
+        long long* optimalTours = nullptr) {
+    if(n < 3) {
+        return tspBruteforce(adjMatrix, n);
+    }
+
+    auto allowed = [&](int from, int to) {
+        return !adjMatrix.forbidden(from, to);
+    };
+
+    // the cities in order of the distance from each city, and the cost of the
+    // cheapest edge leaving it
+    std::vector<int> nearest(n * n);
+    std::vector<int> cheapestOut(n, INT32_MAX);
+    for(int from = 0; from < n; ++from) {
+        int* row = &nearest[from * n];
+        std::iota(row, row + n, 0);
+        std::sort(row, row + n, [&](int a, int b) {
+            return adjMatrix(from, a) < adjMatrix(from, b);
+        });
+        for(int to = 0; to < n; ++to) {
+            if(allowed(from, to)) cheapestOut[from] = std::min<int>(cheapestOut[from], adjMatrix(from, to));
+        }
+    }
+    // a city that can't be left means there's no tour
+    int64_t cheapestOutSum = 0;
+    for(int from = 0; from < n; ++from) {
+        if(cheapestOut[from] == INT32_MAX) return TspSolution{{0, 0}, INT32_MAX};
+        cheapestOutSum += cheapestOut[from];
+    }
+
+    TspSolution heuristic = heuristicTour(adjMatrix, n);
+    std::atomic<int> best{int(heuristic.cost)};
+
+    // the prefixes 0 -> a -> b handed out to the threads, cheapest first
+    struct Prefix {
+        int cost;
+        int a, b;
+    };
+    std::vector<Prefix> prefixes;
+    for(int a = 1; a < n; ++a) {
+        for(int b = 1; b < n; ++b) {
+            if(a != b && allowed(0, a) && allowed(a, b)) {
+                prefixes.push_back({adjMatrix(0, a) + adjMatrix(a, b), a, b});
+            }
+        }
+    }
+    std::sort(prefixes.begin(), prefixes.end(), [](const Prefix& lhs, const Prefix& rhs) {
+        return lhs.cost < rhs.cost;
+    });
+
+    // the results of the threads, merged at the end
+    std::mutex resultsMutex;
+    int bestFound = INT32_MAX;
+    std::vector<int> bestOrder;
+    long long bestCount = 0;
+
+    // a path is abandoned when its bound is over the best cost, or also when
+    // it's equal, if the optimal tours don't have to be counted
+    const bool counting = optimalTours != nullptr;
+    auto pruned = [&](int64_t bound) {
+        int limit = best.load(std::memory_order_relaxed);
+        return counting ? bound > limit : bound >= limit;
+    };
+
+    ThreadPool pool(threads);
+    pool.parallelFor(prefixes.size(), [&](size_t task) {
+        const Prefix& prefix = prefixes[task];
+
+        std::vector<int> path{0, prefix.a, prefix.b};
+        path.reserve(n);
+        uint64_t visited = 1 | (uint64_t(1) << prefix.a) | (uint64_t(1) << prefix.b);
+        int localBest = INT32_MAX;
+        long long localCount = 0;
+        std::vector<int> localOrder;
+
+        // `remaining` is the sum of the cheapest edges leaving the last city
+        // and the ones not visited yet
+        auto search = [&](auto& self, int64_t cost, int64_t remaining) -> void {
+            int last = path.back();
+            if(int(path.size()) == n) {
+                if(!allowed(last, 0)) return;
+
+                int64_t tourCost = cost + adjMatrix(last, 0);
+                if(pruned(tourCost)) return;
+
+                if(tourCost < localBest) {
+                    localBest = tourCost;
+                    localCount = 0;
+                    localOrder = path;
+                }
+                ++localCount;
+
+                // lower the shared best cost, unless another thread did
+                int current = best.load(std::memory_order_relaxed);
+                while(tourCost < current && !best.compare_exchange_weak(current, tourCost)) {}
+                return;
+            }
+
+            const int* row = &nearest[last * n];
+            for(int k = 0; k < n; ++k) {
+                int next = row[k];
+                if((visited & (uint64_t(1) << next)) || !allowed(last, next)) continue;
+
+                int64_t nextCost = cost + adjMatrix(last, next);
+                int64_t nextRemaining = remaining - cheapestOut[last];
+                if(pruned(nextCost + nextRemaining)) {
+                    // the next cities are further away, but the bound of a
+                    // path only grows with the edge it adds
+                    break;
+                }
+
+                visited |= uint64_t(1) << next;
+                path.push_back(next);
+                self(self, nextCost, nextRemaining);
+                path.pop_back();
+                visited &= ~(uint64_t(1) << next);
+            }
+        };
+
+        int64_t remaining = cheapestOutSum - cheapestOut[0] - cheapestOut[prefix.a];
+        if(!pruned(prefix.cost + remaining)) {
+            search(search, prefix.cost, remaining);
+        }
+
+        std::lock_guard lock(resultsMutex);
+        if(localBest < bestFound) {
+            bestFound = localBest;
+            bestCount = 0;
+            bestOrder = localOrder;
+        }
+        if(localBest == bestFound) bestCount += localCount;
+    });
+
+    if(optimalTours) *optimalTours = bestCount;
+
+    // nothing beats the heuristic tour, so it's optimal. If counting, every
+    // tour of that cost was found, including the heuristic one.
+    if(bestOrder.empty()) {
+        return heuristic;
+    }
+    bestOrder.push_back(0);
+    return TspSolution{bestOrder, bestFound};
+}
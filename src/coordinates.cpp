@@ -0,0 +1,246 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "tsplib.cpp"
+#include "neighbour_lists.cpp"
+#include "tour_cost.cpp"
+
+// Instances given by the coordinates of their cities, whose distances are
+// computed when they're needed instead of being stored in an n x n matrix.
+// 100k cities take a few MB instead of the 40 GB of their matrix, so the
+// heuristic solvers can be run on them.
+
+// A k-d tree over the cities, for finding the cities nearest to a given one
+// in O(log n) on average. It's implicit: the cities are sorted so that each
+// range of them has its median in the middle, split along the axis the range
+// is wider in, with the smaller ones before it and the larger ones after.
+class KdTree {
+    // the cities in the order of the tree, and their coordinates in it
+    std::vector<int> cities;
+    std::vector<double> xs, ys;
+    // the axis the range with the median at the index is split along, 0 for x
+    std::vector<uint8_t> axis;
+
+    void build(int low, int high, const std::vector<double>& x, const std::vector<double>& y) {
+        if (high - low <= 1) return;
+
+        auto [minX, maxX] = std::minmax_element(cities.begin() + low, cities.begin() + high,
+            [&](int a, int b) { return x[a] < x[b]; });
+        auto [minY, maxY] = std::minmax_element(cities.begin() + low, cities.begin() + high,
+            [&](int a, int b) { return y[a] < y[b]; });
+        const std::vector<double>& along = x[*maxX] - x[*minX] >= y[*maxY] - y[*minY] ? x : y;
+
+        int middle = (low + high) / 2;
+        std::nth_element(cities.begin() + low, cities.begin() + middle, cities.begin() + high,
+            [&](int a, int b) { return along[a] < along[b]; });
+        axis[middle] = &along == &x ? 0 : 1;
+        build(low, middle, x, y);
+        build(middle + 1, high, x, y);
+    }
+
+    // the k nearest so far, as a max-heap of squared distances
+    struct Found {
+        double distance;
+        int city;
+        bool operator<(const Found& other) const { return distance < other.distance; }
+    };
+
+    void search(int low, int high, double qx, double qy, int exclude, int k, std::vector<Found>& found) const {
+        if (low >= high) return;
+
+        int middle = (low + high) / 2;
+        double dx = xs[middle] - qx, dy = ys[middle] - qy;
+        if (cities[middle] != exclude) {
+            double distance = dx * dx + dy * dy;
+            if (int(found.size()) < k) {
+                found.push_back({distance, cities[middle]});
+                std::push_heap(found.begin(), found.end());
+            }
+            else if (distance < found.front().distance) {
+                std::pop_heap(found.begin(), found.end());
+                found.back() = {distance, cities[middle]};
+                std::push_heap(found.begin(), found.end());
+            }
+        }
+
+        // the side of the split the point is on first, then the other one if
+        // it can still have something nearer
+        double beyond = axis[middle] == 0 ? -dx : -dy;
+        bool before = beyond < 0;
+        search(before ? low : middle + 1, before ? middle : high, qx, qy, exclude, k, found);
+        if (int(found.size()) < k || beyond * beyond < found.front().distance) {
+            search(before ? middle + 1 : low, before ? high : middle, qx, qy, exclude, k, found);
+        }
+    }
+
+public:
+    KdTree(const std::vector<double>& x, const std::vector<double>& y) :
+        cities(x.size()), xs(x.size()), ys(x.size()), axis(x.size())
+    {
+        std::iota(cities.begin(), cities.end(), 0);
+        build(0, cities.size(), x, y);
+        for (size_t i = 0; i < cities.size(); i++) {
+            xs[i] = x[cities[i]];
+            ys[i] = y[cities[i]];
+        }
+    }
+
+    // Writes the (up to) k cities nearest to the point (x, y), other than
+    // `exclude`, to `out`, from the nearest one. Returns how many there are.
+    int nearest(double x, double y, int exclude, int k, int* out) const {
+        std::vector<Found> found;
+        found.reserve(k);
+        search(0, cities.size(), x, y, exclude, k, found);
+        std::sort_heap(found.begin(), found.end());
+        for (size_t i = 0; i < found.size(); i++) out[i] = found[i].city;
+        return found.size();
+    }
+};
+
+// The distances between the cities of an instance given by their coordinates,
+// with the same (from, to) interface as DistanceMatrix. They're computed on
+// every call, unless the cache is turned on.
+//
+// The cache is direct mapped: an edge can only be in the one entry its index
+// hashes to, and replaces whatever was there. Every entry is a single atomic
+// word holding both the edge and its distance, so it's shared by the threads
+// of a solver without locks.
+class CoordinateDistances {
+    struct Cities {
+        std::vector<double> x, y;
+        CoordinateMetric metric;
+        KdTree tree;
+    };
+    std::shared_ptr<const Cities> cities;
+    int n = 0;
+
+    // the edge takes the high bits of an entry, plus one so that 0 is empty
+    static constexpr int CACHE_DISTANCE_BITS = 30;
+    std::shared_ptr<std::vector<std::atomic<uint64_t>>> cache;
+    uint64_t cacheMask = 0;
+
+    int compute(int from, int to) const {
+        const Cities& c = *cities;
+        return coordinateDistance(c.metric, c.x[from], c.y[from], c.x[to], c.y[to]);
+    }
+
+public:
+    // `cacheEntries` is rounded down to a power of two, 0 turns the cache off.
+    // The metric has to be one of the planar ones, EUC_2D, CEIL_2D or ATT.
+    CoordinateDistances(std::vector<double> x, std::vector<double> y, CoordinateMetric metric,
+            size_t cacheEntries = 0) : n(x.size()) {
+        if (metric == CoordinateMetric::Geo) throw std::runtime_error("GEO instances need a matrix");
+        KdTree tree(x, y);
+        cities = std::make_shared<const Cities>(Cities{std::move(x), std::move(y), metric, std::move(tree)});
+
+        // the edge has to fit in the bits left by the distance
+        if (cacheEntries > 0 && uint64_t(n) * n < (uint64_t(1) << (64 - CACHE_DISTANCE_BITS))) {
+            size_t entries = size_t(1) << (63 - __builtin_clzll(cacheEntries));
+            cache = std::make_shared<std::vector<std::atomic<uint64_t>>>(entries);
+            cacheMask = entries - 1;
+        }
+    }
+
+    int size() const { return n; }
+
+    // only the edges from a city to itself, every city can go to any other
+    bool forbidden(int from, int to) const {
+        return from == to;
+    }
+
+    int operator()(int from, int to) const {
+        if (!cache) return compute(from, to);
+
+        // the distances are symmetric, so both directions share an entry
+        uint64_t edge = uint64_t(std::min(from, to)) * n + std::max(from, to) + 1;
+        std::atomic<uint64_t>& entry = (*cache)[(edge * 0x9e3779b97f4a7c15) >> 20 & cacheMask];
+        uint64_t cached = entry.load(std::memory_order_relaxed);
+        if (cached >> CACHE_DISTANCE_BITS == edge) return int(cached & ((uint64_t(1) << CACHE_DISTANCE_BITS) - 1));
+
+        int distance = compute(from, to);
+        if (distance < (1 << CACHE_DISTANCE_BITS)) {
+            entry.store(edge << CACHE_DISTANCE_BITS | uint64_t(distance), std::memory_order_relaxed);
+        }
+        return distance;
+    }
+
+    // writes the (up to) k cities nearest to `city` to `out`, from the nearest
+    // one, and returns how many there are
+    int nearest(int city, int k, int* out) const {
+        return cities->tree.nearest(cities->x[city], cities->y[city], city, k, out);
+    }
+};
+
+// An instance given by the coordinates of its cities, with the same interface
+// as BasicTsp for the heuristic solvers.
+class CoordinateTsp {
+    CoordinateDistances distances;
+    CandidateLists candidateLists;
+
+public:
+    using Distances = CoordinateDistances;
+
+    CoordinateTsp(CoordinateDistances _distances) : distances(std::move(_distances)) {}
+
+    // Loads the NODE_COORD_SECTION of a TSPLIB instance of type EUC_2D,
+    // CEIL_2D or ATT. Throws std::runtime_error for any other one.
+    static CoordinateTsp loadFromTsplib(const std::string& filename, size_t cacheEntries = 0) {
+        MappedFile file = MappedFile::open(filename);
+        const char* begin = reinterpret_cast<const char*>(file.bytes());
+        try {
+            TextScanner text(begin, begin + file.size());
+            TsplibHeader header = parseTsplibHeader(text);
+            CoordinateMetric metric = coordinateMetric(header.weightType);
+            if (header.section != "NODE_COORD_SECTION") throw std::runtime_error("no NODE_COORD_SECTION");
+
+            std::vector<double> x, y;
+            parseTsplibCoordinates(text, header.n, x, y);
+            return CoordinateDistances{std::move(x), std::move(y), metric, cacheEntries};
+        }
+        catch (const std::runtime_error& e) {
+            throw std::runtime_error(filename + ": " + e.what());
+        }
+    }
+
+    size_t size() const { return distances.size(); }
+
+    // distances between points are the same both ways
+    bool isSymmetric() const { return true; }
+
+    bool hasForbiddenEdges() const { return false; }
+
+    int get(size_t x, size_t y) const {
+        return distances(y, x);
+    }
+
+    const CoordinateDistances& getAdjMatrix() const {
+        return distances;
+    }
+
+    // the nearest cities of every city, found with the k-d tree
+    const NeighbourLists& candidates() const {
+        return candidateLists.get(distances, true);
+    }
+
+    double candidatesSeconds() const {
+        return candidateLists.buildSeconds();
+    }
+
+    int64_t cost(const std::vector<int>& order) const {
+        int64_t sum;
+        tourCosts(order.data(), 1, order.size(), false, &sum);
+        return sum;
+    }
+
+    void tourCosts(const int* tours, size_t count, int length, bool closed, int64_t* costs,
+            ThreadPool* pool = nullptr) const {
+        ::tourCosts(distances, tours, count, length, closed, costs, pool);
+    }
+};
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+
+#include "rng.cpp"
+#include "distance_matrix.cpp"
+#include "neighbour_lists.cpp"
+
+// Crossover operators of the genetic algorithm. Each of them writes a child
+// made from two parent tours of n cities into a slot given by the caller, and
+// keeps its scratch space between the calls, so that it doesn't allocate.
+// Tours are cycles, so it doesn't matter which city they are written from.
+
+enum class GaCrossover {
+    // the second parent, with the start of the first one swapped into it
+    Swap,
+    // order crossover (OX)
+    Order,
+    // partially mapped crossover (PMX)
+    Pmx,
+    // edge assembly crossover (EAX), following the edges in their direction
+    Eax,
+};
+
+const char* gaCrossoverName(GaCrossover crossover) {
+    switch (crossover) {
+    case GaCrossover::Order:
+        return "ox";
+    case GaCrossover::Pmx:
+        return "pmx";
+    case GaCrossover::Eax:
+        return "eax";
+    default:
+        return "swap";
+    }
+}
+
+template <typename Distances>
+class Crossover {
+    const Distances& adjMatrix;
+    int n;
+    GaCrossover kind;
+
+    std::vector<int> positionOf;
+
+    // a city is marked if its entry is equal to `stamp`, so that all of them
+    // are unmarked at once by changing it
+    std::vector<uint32_t> mark;
+    uint32_t stamp = 0;
+
+    // EAX: the edges of the parents, the child being assembled, its subtours,
+    // and the candidate lists of the instance, which the subtours are joined
+    // along
+    std::vector<int> successorA, successorB, predecessorB;
+    std::vector<int> successor, predecessor;
+    std::vector<int> subtourOf, subtourSize, subtourStart;
+    const NeighbourLists* candidates = nullptr;
+
+    // forbidden edges count as FORBIDDEN_EDGE_PENALTY, so that subtours are
+    // joined around them whenever they can be
+    int64_t d(int from, int to) const {
+        return penalizedWeight(adjMatrix(from, to));
+    }
+
+    void unmarkAll() {
+        if (++stamp == 0) {
+            std::fill(mark.begin(), mark.end(), 0);
+            stamp = 1;
+        }
+    }
+
+    // a random segment a .. b of the tour, both included
+    std::pair<int, int> randomSegment(Rng& rng) const {
+        int a = rng.below(n);
+        int b = rng.below(n);
+        return {std::min(a, b), std::max(a, b)};
+    }
+
+    // Writes the second parent, with the cities of the first one up to a
+    // random breakpoint swapped into the same positions as in the first.
+    // Keeping where each city of the child is makes every swap O(1).
+    void swapCrossover(const int* parent1, const int* parent2, int* child, Rng& rng) {
+        int breakpoint = rng.between(n / 4, n - (n / 4));
+
+        std::copy(parent2, parent2 + n, child);
+        for (int i = 0; i < n; i++) {
+            positionOf[child[i]] = i;
+        }
+        for (int i = 0; i < breakpoint; i++) {
+            int j = positionOf[parent1[i]];
+            std::swap(child[i], child[j]);
+            positionOf[child[i]] = i;
+            positionOf[child[j]] = j;
+        }
+    }
+
+    // Copies a random segment of the first parent, and fills the rest of the
+    // child with the other cities in the order of the second one, starting
+    // after the segment.
+    void orderCrossover(const int* parent1, const int* parent2, int* child, Rng& rng) {
+        auto [a, b] = randomSegment(rng);
+
+        unmarkAll();
+        for (int i = a; i <= b; i++) {
+            child[i] = parent1[i];
+            mark[parent1[i]] = stamp;
+        }
+
+        int write = (b + 1) % n;
+        for (int k = 0; k < n; k++) {
+            int city = parent2[(b + 1 + k) % n];
+            if (mark[city] == stamp) continue;
+            child[write] = city;
+            write = (write + 1) % n;
+        }
+    }
+
+    // Copies a random segment of the first parent, and keeps the positions of
+    // the second one for the rest of the cities. A city of the second parent
+    // that is already in the segment is replaced by the one that the segment
+    // displaced from its position, following the mapping until it leads out.
+    void pmxCrossover(const int* parent1, const int* parent2, int* child, Rng& rng) {
+        auto [a, b] = randomSegment(rng);
+
+        for (int i = 0; i < n; i++) {
+            positionOf[parent1[i]] = i;
+        }
+        unmarkAll();
+        for (int i = a; i <= b; i++) {
+            child[i] = parent1[i];
+            mark[parent1[i]] = stamp;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (i == a) {
+                i = b;
+                continue;
+            }
+            int city = parent2[i];
+            while (mark[city] == stamp) {
+                city = parent2[positionOf[city]];
+            }
+            child[i] = city;
+        }
+    }
+
+    // Starts from the edges of the first parent and swaps in the edges of the
+    // second one along a random AB-cycle: a cycle that alternates between an
+    // edge of the first parent, taken forward, and one of the second, taken
+    // backward. Every city keeps one edge in and one out, so the result is a
+    // set of subtours. They are joined into one tour by repeatedly connecting
+    // the smallest of them to another with the cheapest exchange of two edges
+    // that keeps their direction, looking at the nearest cities first.
+    void eaxCrossover(const int* parent1, const int* parent2, int* child, Rng& rng) {
+        for (int i = 0; i < n; i++) {
+            int next = (i + 1) % n;
+            successorA[parent1[i]] = parent1[next];
+            successorB[parent2[i]] = parent2[next];
+            predecessorB[parent2[next]] = parent2[i];
+        }
+
+        // the AB-cycles are the cycles of the permutation
+        // u -> predecessorB(successorA(u)), one of them is picked at random.
+        // The ones of a single city are edges shared by both parents.
+        unmarkAll();
+        int chosen = -1;
+        int cycles = 0;
+        for (int u = 0; u < n; u++) {
+            if (mark[u] == stamp) continue;
+            int v = u;
+            do {
+                mark[v] = stamp;
+                v = predecessorB[successorA[v]];
+            } while (v != u);
+
+            if (predecessorB[successorA[u]] != u) {
+                ++cycles;
+                if (rng.below(cycles) == 0) chosen = u;
+            }
+        }
+        if (chosen == -1) {
+            std::copy(parent1, parent1 + n, child);
+            return;
+        }
+
+        successor = successorA;
+        int u = chosen;
+        do {
+            successor[u] = successorB[u];
+            u = predecessorB[successorA[u]];
+        } while (u != chosen);
+        for (int c = 0; c < n; c++) {
+            predecessor[successor[c]] = c;
+        }
+
+        int subtours = 0;
+        std::fill(subtourOf.begin(), subtourOf.end(), -1);
+        for (int c = 0; c < n; c++) {
+            if (subtourOf[c] != -1) continue;
+            subtourStart[subtours] = c;
+            subtourSize[subtours] = 0;
+            int v = c;
+            do {
+                subtourOf[v] = subtours;
+                ++subtourSize[subtours];
+                v = successor[v];
+            } while (v != c);
+            ++subtours;
+        }
+
+        for (int left = subtours; left > 1; --left) {
+            int smallest = -1;
+            for (int s = 0; s < subtours; s++) {
+                if (subtourSize[s] > 0 && (smallest == -1 || subtourSize[s] < subtourSize[smallest])) {
+                    smallest = s;
+                }
+            }
+
+            // the exchange replaces u -> su and v -> w with u -> w and v -> su
+            int64_t bestDelta = INT64_MAX;
+            int bestU = -1, bestV = -1;
+            auto consider = [&](int u, int w) {
+                if (subtourOf[w] == smallest) return;
+                int su = successor[u];
+                int v = predecessor[w];
+                int64_t delta = d(u, w) + d(v, su) - d(u, su) - d(v, w);
+                if (delta < bestDelta) {
+                    bestDelta = delta;
+                    bestU = u;
+                    bestV = v;
+                }
+            };
+            int start = subtourStart[smallest];
+            u = start;
+            do {
+                for (int k = 0; k < candidates->k; k++) consider(u, candidates->out[u * candidates->k + k]);
+                u = successor[u];
+            } while (u != start);
+            // none of the nearest cities is outside, so look at all of them
+            if (bestU == -1) {
+                do {
+                    for (int w = 0; w < n; w++) consider(u, w);
+                    u = successor[u];
+                } while (u != start);
+            }
+
+            int su = successor[bestU];
+            int w = successor[bestV];
+            successor[bestU] = w;
+            predecessor[w] = bestU;
+            successor[bestV] = su;
+            predecessor[su] = bestV;
+
+            // the cities of the smallest subtour now go from su to u
+            int target = subtourOf[w];
+            for (int v = su; ; v = successor[v]) {
+                subtourOf[v] = target;
+                if (v == bestU) break;
+            }
+            subtourSize[target] += subtourSize[smallest];
+            subtourSize[smallest] = 0;
+        }
+
+        int city = parent1[0];
+        for (int i = 0; i < n; i++) {
+            child[i] = city;
+            city = successor[city];
+        }
+    }
+
+public:
+    // `_candidates` are the candidate lists of the instance, used by EAX
+    Crossover(const Distances& _adjMatrix, int _n, GaCrossover _kind, const NeighbourLists& _candidates) :
+        adjMatrix(_adjMatrix), n(_n), kind(_kind), positionOf(_n), mark(_n, 0)
+    {
+        if (kind != GaCrossover::Eax) return;
+
+        for (auto* buffer : {&successorA, &successorB, &predecessorB, &successor, &predecessor,
+                &subtourOf, &subtourSize, &subtourStart}) {
+            buffer->resize(n);
+        }
+        candidates = &_candidates;
+    }
+
+    // writes a child of the two parents to `child`
+    void operator()(const int* parent1, const int* parent2, int* child, Rng& rng) {
+        switch (kind) {
+        case GaCrossover::Order:
+            orderCrossover(parent1, parent2, child, rng);
+            break;
+        case GaCrossover::Pmx:
+            pmxCrossover(parent1, parent2, child, rng);
+            break;
+        case GaCrossover::Eax:
+            eaxCrossover(parent1, parent2, child, rng);
+            break;
+        default:
+            swapCrossover(parent1, parent2, child, rng);
+            break;
+        }
+    }
+};
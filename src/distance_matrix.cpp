@@ -0,0 +1,164 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#include "allowed_arcs.cpp"
+
+// rows of a matrix start on a cache line
+const size_t MATRIX_ALIGNMENT = 64;
+
+// the weight of an edge that no tour may use, which the diagonal always holds
+const int FORBIDDEN_EDGE = -1;
+
+// What the local search heuristics count a forbidden edge as, so that no move
+// that adds one ever looks like an improvement: far more than a move between
+// allowed edges can gain, and little enough that a tour of millions of them
+// still fits in 64 bits.
+const int64_t FORBIDDEN_EDGE_PENALTY = int64_t(1) << 40;
+
+// the weight of an edge for the local search heuristics, from the weight the
+// instance gives it
+inline int64_t penalizedWeight(int weight) {
+    return weight == FORBIDDEN_EDGE ? FORBIDDEN_EDGE_PENALTY : weight;
+}
+
+// whether `weight` can be stored as a `Weight`
+template <typename Weight>
+bool fitsWeight(int64_t weight) {
+    return weight >= std::numeric_limits<Weight>::min() && weight <= std::numeric_limits<Weight>::max();
+}
+
+// Weights of the edges of an instance: (from, to) is the weight of the edge
+// from -> to. `Weight` is the narrowest integer type that the weights fit in,
+// chosen when the instance is loaded (see loadTsp), so that as much of the
+// matrix as possible fits in the caches.
+//
+// Rows are padded with zeros to a multiple of MATRIX_ALIGNMENT bytes, so that
+// each starts on a cache line and can be read with aligned vector loads. The
+// weights are shared by the copies of a matrix, and may be a part of the
+// mapping of a binary instance file. Edges of weight FORBIDDEN_EDGE are left
+// out of every tour (see AllowedArcs).
+template <typename Weight>
+class DistanceMatrix {
+    std::shared_ptr<const void> storage;
+    const Weight* weights = nullptr;
+    size_t rowStride = 0;
+    int n = 0;
+
+    // the transposed matrix, built the first time it's asked for
+    struct TransposedCache {
+        std::once_flag built;
+        std::unique_ptr<DistanceMatrix> matrix;
+    };
+    std::shared_ptr<TransposedCache> transposedCache = std::make_shared<TransposedCache>();
+
+    // the allowed arcs, found the first time they're asked for
+    struct ArcsCache {
+        std::once_flag built;
+        AllowedArcs arcs;
+    };
+    std::shared_ptr<ArcsCache> arcsCache = std::make_shared<ArcsCache>();
+
+    // allocates a zeroed matrix of n aligned rows and returns its weights
+    Weight* allocate(int _n) {
+        n = _n;
+        rowStride = (n * sizeof(Weight) + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT / sizeof(Weight);
+        size_t bytes = std::max<size_t>(n * rowStride * sizeof(Weight), 1);
+        Weight* data = static_cast<Weight*>(::operator new(bytes, std::align_val_t(MATRIX_ALIGNMENT)));
+        std::memset(data, 0, bytes);
+        storage = std::shared_ptr<Weight>(data, [](Weight* p) { ::operator delete(p, std::align_val_t(MATRIX_ALIGNMENT)); });
+        weights = data;
+        return data;
+    }
+
+public:
+    using weight_type = Weight;
+
+    DistanceMatrix() = default;
+
+    // Copies the n x n matrix `adjMatrix`, stored row after row. Throws
+    // std::runtime_error if a weight doesn't fit in `Weight`. The diagonal
+    // isn't a part of any tour, and whatever the instance puts there (TSPLIB
+    // files have 0s or 100000000s) is replaced with FORBIDDEN_EDGE.
+    DistanceMatrix(const std::vector<int>& adjMatrix, int _n) {
+        Weight* data = allocate(_n);
+        for (int from = 0; from < n; ++from) {
+            for (int to = 0; to < n; ++to) {
+                int weight = from == to ? FORBIDDEN_EDGE : adjMatrix[size_t(from) * n + to];
+                if (!fitsWeight<Weight>(weight)) {
+                    throw std::runtime_error("weight out of range: " + std::to_string(weight));
+                }
+                data[from * rowStride + to] = weight;
+            }
+        }
+    }
+
+    // uses n rows of weights owned by `_storage`, `_stride` weights apart,
+    // without copying them
+    DistanceMatrix(std::shared_ptr<const void> _storage, const Weight* _weights, size_t _stride, int _n) :
+        storage(std::move(_storage)), weights(_weights), rowStride(_stride), n(_n) {}
+
+    int size() const { return n; }
+
+    // number of weights from the start of a row to the start of the next one
+    size_t stride() const { return rowStride; }
+
+    Weight operator()(int from, int to) const {
+        return weights[from * rowStride + to];
+    }
+
+    // whether no tour may go from -> to
+    bool forbidden(int from, int to) const {
+        return from == to || (*this)(from, to) == FORBIDDEN_EDGE;
+    }
+
+    // The arcs that tours may use, with their lists if few enough of them
+    // are. Like the transposed matrix, they're found on the first call and
+    // then shared.
+    const AllowedArcs& allowedArcs() const {
+        std::call_once(arcsCache->built, [&] {
+            arcsCache->arcs = AllowedArcs(n, [&](int from, int to) { return forbidden(from, to); },
+                SPARSE_ARCS_DENSITY);
+        });
+        return arcsCache->arcs;
+    }
+
+    // the weights of the edges leaving `from`
+    const Weight* row(int from) const {
+        return weights + from * rowStride;
+    }
+
+    // The matrix with the direction of every edge reversed, whose rows are
+    // the columns of this one, for scans down a column. It's built on the
+    // first call, which is safe to make from many threads, and then shared.
+    const DistanceMatrix& transposed() const {
+        std::call_once(transposedCache->built, [&] {
+            auto matrix = std::make_unique<DistanceMatrix>();
+            Weight* data = matrix->allocate(n);
+            for (int from = 0; from < n; ++from) {
+                for (int to = 0; to < n; ++to) data[to * rowStride + from] = (*this)(from, to);
+            }
+            transposedCache->matrix = std::move(matrix);
+        });
+        return *transposedCache->matrix;
+    }
+};
+
+// the size in bytes of the narrowest weight type (16 or 32 bit) that the n x n
+// matrix `adjMatrix` fits in, leaving out the diagonal
+int narrowestWeightBytes(const std::vector<int>& adjMatrix, int n) {
+    for (int from = 0; from < n; ++from) {
+        for (int to = 0; to < n; ++to) {
+            if (from != to && !fitsWeight<int16_t>(adjMatrix[size_t(from) * n + to])) return sizeof(int32_t);
+        }
+    }
+    return sizeof(int16_t);
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <immintrin.h>
+
+// Kernels for the innermost loop of `tspDp`. Given the costs of the paths
+// through a set, ending in each of the m cities, and the column of the matrix
+// with the costs of going from each of those cities to the next one, they find
+// the cheapest way to extend the paths:
+//     min over e of costs[e] + column[e]
+// Cities outside of the set have their cost set to `DP_INFINITY`, so the
+// kernels go over all m cities without checking which of them are in the set.
+
+// large enough to never be the minimum, small enough to not overflow when a
+// distance is added to it
+const int DP_INFINITY = INT32_MAX / 2;
+
+struct DpMinimum {
+    int cost;
+    int end;
+};
+
+using DpMinKernel = DpMinimum (*)(const int* costs, const int* column, int m);
+
+// Sparse isn't one of the kernels below: it goes only over the cities of the
+// set that have an allowed arc to the next one (see dpArcsInto), which is
+// what Auto picks when the instance has lists of allowed arcs.
+enum class DpKernel { Auto, Scalar, Sse, Avx2, Sparse };
+
+DpMinimum dpMinScalar(const int* costs, const int* column, int m) {
+    DpMinimum best{INT32_MAX, 0};
+    for(int e = 0; e < m; ++e) {
+        int distance = costs[e] + column[e];
+        bool better = distance < best.cost;
+        best.cost = better ? distance : best.cost;
+        best.end = better ? e : best.end;
+    }
+    return best;
+}
+
+__attribute__((target("sse4.1")))
+DpMinimum dpMinSse(const int* costs, const int* column, int m) {
+    __m128i best = _mm_set1_epi32(INT32_MAX);
+    __m128i bestEnd = _mm_setzero_si128();
+    __m128i ends = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i step = _mm_set1_epi32(4);
+
+    int e = 0;
+    for(; e + 4 <= m; e += 4) {
+        __m128i distance = _mm_add_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(costs + e)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(column + e)));
+        __m128i better = _mm_cmpgt_epi32(best, distance);
+        best = _mm_min_epi32(best, distance);
+        bestEnd = _mm_blendv_epi8(bestEnd, ends, better);
+        ends = _mm_add_epi32(ends, step);
+    }
+
+    // spread the minimum to all the lanes, then take the end from the first
+    // lane that holds it
+    __m128i minimum = _mm_min_epi32(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+    minimum = _mm_min_epi32(minimum, _mm_shuffle_epi32(minimum, _MM_SHUFFLE(2, 3, 0, 1)));
+    int lane = __builtin_ctz(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(best, minimum))));
+
+    alignas(16) int laneEnd[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(laneEnd), bestEnd);
+    DpMinimum result{_mm_cvtsi128_si32(minimum), laneEnd[lane]};
+
+    // at most 3 cities left, not worth a masked load without AVX
+    for(; e < m; ++e) {
+        int distance = costs[e] + column[e];
+        bool better = distance < result.cost;
+        result.cost = better ? distance : result.cost;
+        result.end = better ? e : result.end;
+    }
+    return result;
+}
+
+__attribute__((target("avx2")))
+DpMinimum dpMinAvx2(const int* costs, const int* column, int m) {
+    __m256i best = _mm256_set1_epi32(INT32_MAX);
+    __m256i bestEnd = _mm256_setzero_si256();
+    __m256i ends = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step = _mm256_set1_epi32(8);
+
+    int e = 0;
+    for(; e + 8 <= m; e += 8) {
+        __m256i distance = _mm256_add_epi32(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(costs + e)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + e)));
+        __m256i better = _mm256_cmpgt_epi32(best, distance);
+        best = _mm256_min_epi32(best, distance);
+        bestEnd = _mm256_blendv_epi8(bestEnd, ends, better);
+        ends = _mm256_add_epi32(ends, step);
+    }
+
+    // the remaining cities are read with a masked load, which does not touch
+    // the memory of the lanes that are switched off
+    if(e < m) {
+        __m256i lanes = _mm256_cmpgt_epi32(_mm256_set1_epi32(m - e),
+            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256i distance = _mm256_add_epi32(
+            _mm256_maskload_epi32(costs + e, lanes),
+            _mm256_maskload_epi32(column + e, lanes));
+        __m256i better = _mm256_and_si256(_mm256_cmpgt_epi32(best, distance), lanes);
+        best = _mm256_blendv_epi8(best, distance, better);
+        bestEnd = _mm256_blendv_epi8(bestEnd, ends, better);
+    }
+
+    // spread the minimum to all the lanes, then take the end from the first
+    // lane that holds it
+    __m256i minimum = _mm256_min_epi32(best, _mm256_permute2x128_si256(best, best, 1));
+    minimum = _mm256_min_epi32(minimum, _mm256_shuffle_epi32(minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+    minimum = _mm256_min_epi32(minimum, _mm256_shuffle_epi32(minimum, _MM_SHUFFLE(2, 3, 0, 1)));
+    int lane = __builtin_ctz(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(best, minimum))));
+
+    alignas(32) int laneEnd[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(laneEnd), bestEnd);
+    return DpMinimum{_mm256_cvtsi256_si32(minimum), laneEnd[lane]};
+}
+
+// returns the requested kernel, or the widest one the CPU supports for Auto
+DpMinKernel dpMinKernel(DpKernel kernel) {
+    if(kernel == DpKernel::Auto) {
+        if(__builtin_cpu_supports("avx2")) kernel = DpKernel::Avx2;
+        else if(__builtin_cpu_supports("sse4.1")) kernel = DpKernel::Sse;
+        else kernel = DpKernel::Scalar;
+    }
+
+    switch(kernel) {
+    case DpKernel::Avx2:
+        return dpMinAvx2;
+    case DpKernel::Sse:
+        return dpMinSse;
+    default:
+        return dpMinScalar;
+    }
+}
+
+const char* dpKernelName(DpKernel kernel) {
+    switch(kernel) {
+    case DpKernel::Avx2:
+        return "avx2";
+    case DpKernel::Sse:
+        return "sse4.1";
+    case DpKernel::Scalar:
+        return "scalar";
+    case DpKernel::Sparse:
+        return "sparse";
+    default:
+        return "auto";
+    }
+}
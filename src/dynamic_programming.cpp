@@ -2,145 +2,642 @@
 
 #include <iostream>
 #include <vector>
-#include <unordered_set>
 #include <cstdint>
+#include <bit>
+#include <memory>
+#include <array>
+#include <algorithm>
 
 #include "lib.h"
+#include "thread_pool.cpp"
+#include "mapped_file.cpp"
+#include "dp_kernels.cpp"
 
-void generateSetsA(int set, int at, int k, int n, std::unordered_set<int>& sets) {
-    if(k == 0) {
-        sets.insert(set);
-        return;
+// Subsets handled by the dynamic programming solution never contain the
+// starting city, so only the remaining n - 1 cities get a bit in the set. City
+// `c` (for c != start) is represented by bit `c - 1` when start = 0, which
+// halves the number of states compared to giving the start city a bit as well.
+using DpSet = uint64_t;
+
+// we check if the set contains the city given by the bit position `bit`
+bool setContains(DpSet set, int bit) {
+    return ((DpSet(1) << bit) & set) != 0;
+}
+
+// returns the next greater set with the same number of elements (Gosper's
+// hack). Iterating with it visits all sets of a given size in increasing
+// numerical order, so the sets of size k - 1 that a layer reads from are also
+// visited in an ascending, predictable pattern.
+DpSet nextSet(DpSet set) {
+    DpSet lowest = set & -set;
+    DpSet ripple = set + lowest;
+    return (((ripple ^ set) >> 2) / lowest) | ripple;
+}
+
+// binomial coefficients C(n, k) for all n, k that fit a DpSet
+const std::array<std::array<uint64_t, 65>, 65> BINOMIALS = [] {
+    std::array<std::array<uint64_t, 65>, 65> c{};
+    for(int n = 0; n <= 64; ++n) {
+        c[n][0] = 1;
+        for(int k = 1; k <= n; ++k) {
+            c[n][k] = c[n - 1][k - 1] + c[n - 1][k];
+        }
     }
+    return c;
+}();
 
-    for(int i = at; i < n; ++i) {
-        // generate a combination with i-th bit set
-        set |= (1 << i);
-        generateSetsA(set, i + 1, k - 1, n, sets);
+uint64_t binomial(int n, int k) {
+    if(k < 0 || k > n) return 0;
+    return BINOMIALS[n][k];
+}
+
+// returns the set of size k that is `rank`-th (counting from 0) in the order
+// in which `nextSet` visits them. That order is the colexicographic one, in
+// which the rank of a set {c_1 < c_2 < ... < c_k} is the sum of C(c_i, i), so
+// we recover the elements from the largest one down.
+DpSet unrankSet(uint64_t rank, int k) {
+    DpSet set = 0;
+    int c = 63;
+    for(int i = k; i >= 1; --i) {
+        while(binomial(c, i) > rank) --c;
+        set |= DpSet(1) << c;
+        rank -= binomial(c, i);
+        --c;
+    }
+    return set;
+}
+
+// returns the rank of the set in the order `nextSet` visits the sets of its
+// size, the inverse of `unrankSet`
+uint64_t rankSet(DpSet set) {
+    uint64_t rank = 0;
+    int i = 1;
+    for(; set != 0; set &= set - 1, ++i) {
+        rank += binomial(std::countr_zero(set), i);
+    }
+    return rank;
+}
 
-        // flip the bit off. in the next iteration of the loop we will be
-        // considering next bits, and as such, the combinations without now i-th
-        // bit set will be generated
-        set &= ~(1 << i);
+// Writes the ranks of the set of the k `cities`, in increasing order, without
+// each one of them to `ranks`. The rank of the set without its j-th city is
+// the sum of the terms of the cities before it, and of the cities after it,
+// each one position lower, so all of them take O(k).
+void ranksWithout(const int* cities, int k, uint64_t* ranks) {
+    uint64_t suffix[65];
+    suffix[k] = 0;
+    for(int i = k - 1; i >= 0; --i) {
+        suffix[i] = suffix[i + 1] + binomial(cities[i], i);
+    }
+    uint64_t prefix = 0;
+    for(int j = 0; j < k; ++j) {
+        ranks[j] = prefix + suffix[j + 1];
+        prefix += binomial(cities[j], j + 1);
     }
 }
 
-// function generates all sets for n number of cities with k cities visited
-// the type of the topmost set is int because int is used as a bitfield
-// indicating which cities have been visited, where the bit position is the
-// index of the city visited.
-std::unordered_set<int> generateSets(int k, int n) {
-    std::unordered_set<int> sets;
-    generateSetsA(0, 0, k, n, sets);
-    return sets;
+// number of sets that a single task handles when a layer is split between
+// threads. It has to be large enough to make claiming the task cheap, and
+// consecutive sets keep their rows of the table next to each other, so a task
+// writes to a mostly contiguous block of memory that no other task touches.
+const uint64_t DP_MIN_SETS_PER_TASK = 1024;
+const int DP_TASKS_PER_THREAD = 8;
+
+// marks the predecessor of the cities visited directly after the start
+const uint8_t DP_NO_PREDECESSOR = UINT8_MAX;
+
+// the weight of an edge in the tables, DP_INFINITY if it's forbidden, so
+// that no path that takes it is ever the cheapest one
+template <typename Weight>
+int dpWeight(const DistanceMatrix<Weight>& adjMatrix, int from, int to) {
+    return adjMatrix.forbidden(from, to) ? DP_INFINITY : adjMatrix(from, to);
 }
 
-// we check if the set contains the city given by the index `node`, by checking
-// whether the bit at position `node` is set
-bool setContains(int set, int node) {
-    return ((1 << node) & set) != 0;
+// For every city other than the start one, by its bit, the set of the cities
+// that have an allowed arc to it, taken from the lists of allowed arcs. The
+// sparse inner loop only goes over the part of them in the set.
+template <typename Weight>
+std::vector<DpSet> dpArcsInto(const DistanceMatrix<Weight>& adjMatrix, int n, int start) {
+    const AllowedArcs& arcs = adjMatrix.allowedArcs();
+    std::vector<DpSet> into(n - 1, 0);
+    auto bit = [&](int city) { return city < start ? city : city - 1; };
+    for(int city = 0; city < n; ++city) {
+        if(city == start) continue;
+        auto add = [&](int from) {
+            if(from != start) into[bit(city)] |= DpSet(1) << bit(from);
+        };
+        if(arcs.listed) {
+            for(int from : arcs.in(city)) add(from);
+        }
+        else {
+            for(int from = 0; from < n; ++from) {
+                if(!adjMatrix.forbidden(from, city)) add(from);
+            }
+        }
+    }
+    return into;
 }
 
-// calculates the solution using the dynamic programming approach
-TspSolution tspDp(const std::vector<int>& adjMatrix, const int n) {
-    int start = 0;
+// what the dynamic programming solutions return when there's no tour
+const TspSolution DP_NO_TOUR = TspSolution{{0, 0}, INT32_MAX};
 
-    // A 2D array that:
-    // in the 1st dimension has city index, so for each city:
-    // in the 2nd dimension has all the bitfield sets which designate a path
-    // to reach a given city, so for each path:
-    // we finally store the cost to reach the node in the 1st dimension, by the
-    // path in the 2nd dimension
-    std::vector<std::vector<int>> distances(n, std::vector<int>(1 << n, 0));
+// On a symmetric instance a path costs the same in both directions, so every
+// tour is a path from the start through the first `a` cities, an edge, and a
+// path through the other `b` = m - a cities walked back to the start. Then
+// only the layers up to b = ceil(m / 2) are needed, and the last one is
+// joined with the layer a of the cities left out of each of its sets. The
+// layers of the larger sets are the expensive ones, so this is about half of
+// the work.
+struct DpHalves {
+    int cost = INT32_MAX;
+    // the set of the path walked back, and the bits of the cities the two
+    // paths end in
+    DpSet second = 0;
+    int firstEnd = 0;
+    int secondEnd = 0;
+};
+
+// calculates the solution using the dynamic programming approach. All the sets
+// of a given size only depend on the sets one element smaller, so every layer
+// is split into ranges of consecutive sets that `threads` threads work on at
+// the same time (0 means all hardware threads). Each set is written by exactly
+// one thread, so the table needs no locking.
+// `kernel` chooses the implementation of the innermost loop, by default the
+// fastest one the CPU supports, or the sparse loop if the instance has lists
+// of allowed arcs. With the Symmetric tag, only the layers up to half of the
+// cities are computed (see DpHalves), and the table only has rows for their
+// sets. That's a bit over half of all the sets (68% of them for n = 20, 58%
+// for n = 23), so it takes that much less memory. Forbidden edges are never
+// taken, and if no tour goes around them, DP_NO_TOUR is returned.
+template <typename Symmetry = Asymmetric, typename Weight>
+TspSolution tspDp(const DistanceMatrix<Weight>& adjMatrix, const int n, int threads = 1,
+        DpKernel kernel = DpKernel::Auto) {
+    const int start = 0;
+    if(n < 2) {
+        return TspSolution{std::vector<int>(2, start), 0};
+    }
+
+    // number of cities that can be a part of the set
+    const int m = n - 1;
+    const size_t states = size_t(1) << m;
+
+    ThreadPool pool(threads);
+
+    // the size of the sets of the last layer
+    const int b = Symmetry::symmetric && m >= 2 ? (m + 1) / 2 : m;
+    const int a = m - b;
+
+    // With the Symmetric tag, the sets of size k have the rows from
+    // layerRows[k] on, in the order of their ranks. Otherwise every set has
+    // the row of its own number.
+    std::vector<uint64_t> layerRows(b + 2, 0);
+    layerRows[1] = 1;
+    for(int k = 1; k <= b; ++k) {
+        layerRows[k + 1] = layerRows[k] + binomial(m, k);
+    }
+    const size_t rows = Symmetry::symmetric ? layerRows[b + 1] : states;
+    auto rowOf = [&](DpSet set) -> size_t {
+        if constexpr(Symmetry::symmetric) return layerRows[std::popcount(set)] + rankSet(set);
+        else return set;
+    };
+
+    // A flat table of the states, stored set-major: for each set, the cost of
+    // the shortest path that starts in the start city, visits all the cities
+    // in the set and ends in the city given by the bit position lies at
+    // `rowOf(set) * m + bit`. Together with it we store the bit position of
+    // the city visited before the last one, so that the path can be read back
+    // without recalculating the costs.
+    // The entries of cities outside of the set hold `DP_INFINITY`, so that the
+    // minimum can be taken over all the cities. Pages are handed out on first
+    // write, and having the threads fill the whole table spreads it over the
+    // memory of all the NUMA nodes instead of the one the calling thread runs
+    // on.
+    std::unique_ptr<int[]> distances(new int[rows * m]);
+    std::unique_ptr<uint8_t[]> predecessors(new uint8_t[rows * m]);
+    {
+        const size_t chunks = pool.size();
+        pool.parallelFor(chunks, [&](size_t chunk) {
+            size_t first = rows * chunk / chunks * m;
+            size_t last = rows * (chunk + 1) / chunks * m;
+            std::fill(&distances[first], &distances[0] + last, DP_INFINITY);
+            std::fill(&predecessors[first], &predecessors[0] + last, DP_NO_PREDECESSOR);
+        });
+    }
+
+    // the city represented by a given bit position
+    auto city = [&](int bit) { return bit + 1; };
 
     // start by initializing all the direct paths from start node to all the
     // other nodes
-    for(int i = 0; i < n; ++i) {
-        if(i == start) continue;
+    for(int bit = 0; bit < m; ++bit) {
+        distances[rowOf(DpSet(1) << bit) * m + bit] = dpWeight(adjMatrix, start, city(bit));
+    }
 
-        distances[i][1 << start | 1 << i] = adjMatrix[index(start, i, n)];
+    // a column-major copy of the matrix without the start city, so that the
+    // costs of reaching a city from all the others lie next to each other
+    std::vector<int> columns(m * m);
+    for(int next = 0; next < m; ++next) {
+        for(int end = 0; end < m; ++end) {
+            columns[next * m + end] = dpWeight(adjMatrix, city(end), city(next));
+        }
     }
 
-    // for all sets of size 3 up to n
-    for(int k = 3; k <= n; ++k) {
-        // for each set of size k
-        std::unordered_set<int> sets = generateSets(k, n);
-        for(auto& set: sets) {
-            // set has to contain starting node
-            if(!setContains(set, start)) continue;
+    const bool sparse = kernel == DpKernel::Sparse
+        || (kernel == DpKernel::Auto && adjMatrix.allowedArcs().listed);
+    const DpMinKernel minimum = dpMinKernel(sparse ? DpKernel::Auto : kernel);
+    const std::vector<DpSet> arcsInto = sparse ? dpArcsInto(adjMatrix, n, start) : std::vector<DpSet>();
 
-            for(int next = 0; next < n; ++next) {
-                if(next == start || !setContains(set, next)) continue;
+    // computes `count` consecutive sets of size k, starting from the one of
+    // rank `first`
+    auto computeSets = [&](int k, uint64_t first, uint64_t count) {
+        DpSet set = unrankSet(first, k);
+        int cities[64];
+        // the rows of the set without each of its cities
+        size_t previousRows[64];
+        uint64_t previousRanks[64];
 
-                int currentPath = set & ~(1 << next);
-                int minDistance = INT32_MAX;
+        for(uint64_t s = 0; s < count; ++s, set = nextSet(set)) {
+            int size = 0;
+            for(DpSet c = set; c != 0; c &= c - 1) {
+                cities[size++] = std::countr_zero(c);
+            }
+            size_t row = set;
+            if constexpr(Symmetry::symmetric) {
+                row = layerRows[k] + first + s;
+                ranksWithout(cities, k, previousRanks);
+                for(int j = 0; j < k; ++j) previousRows[j] = layerRows[k - 1] + previousRanks[j];
+            }
+            else {
+                for(int j = 0; j < k; ++j) previousRows[j] = set & ~(DpSet(1) << cities[j]);
+            }
+            int* current = &distances[row * m];
+            uint8_t* currentPredecessors = &predecessors[row * m];
+
+            // for each city in the set, take it as the one visited last
+            for(int j = 0; j < k; ++j) {
+                int next = cities[j];
+                DpSet previousSet = set & ~(DpSet(1) << next);
 
-                for(int end = 0; end < n; ++end) {
-                    if(end == start || end == next || !setContains(set, end))
-                        continue;
-                    
-                    int newDistance = distances[end][currentPath]
-                        + adjMatrix[index(end, next, n)];
-                    if(newDistance < minDistance) minDistance = newDistance;
+                // and find the cheapest path that visits the rest of the
+                // cities and then goes to it. Costs past DP_INFINITY are
+                // paths that can't be taken, and are kept at it.
+                const int* previous = &distances[previousRows[j] * m];
+                const int* column = &columns[next * m];
+                DpMinimum best{DP_INFINITY, 0};
+                if(sparse) {
+                    for(DpSet ends = previousSet & arcsInto[next]; ends != 0; ends &= ends - 1) {
+                        int end = std::countr_zero(ends);
+                        int cost = previous[end] + column[end];
+                        if(cost < best.cost) best = DpMinimum{cost, end};
+                    }
                 }
-                distances[next][set] = minDistance;
+                else {
+                    best = minimum(previous, column, m);
+                }
+                current[next] = std::min(best.cost, DP_INFINITY);
+                currentPredecessors[next] = best.end;
             }
         }
+    };
+
+    // for all sets of size 2 up to b, in increasing numerical order
+    for(int k = 2; k <= b; ++k) {
+        const uint64_t sets = binomial(m, k);
+        const uint64_t perTask = std::max(DP_MIN_SETS_PER_TASK,
+            sets / (uint64_t(pool.size()) * DP_TASKS_PER_THREAD) + 1);
+        const uint64_t tasks = (sets + perTask - 1) / perTask;
+
+        pool.parallelFor(tasks, [&](size_t task) {
+            uint64_t first = task * perTask;
+            uint64_t count = std::min(perTask, sets - first);
+            computeSets(k, first, count);
+        });
+    }
+
+    // writes the cities of the shortest path through `state` ending in `bit`
+    // to `path`, in the order they're visited
+    auto readPath = [&](DpSet state, int bit, int* path) {
+        for(int i = std::popcount(state) - 1; i >= 0; --i) {
+            path[i] = city(bit);
+            int previous = predecessors[rowOf(state) * m + bit];
+            state &= ~(DpSet(1) << bit);
+            bit = previous;
+        }
+    };
+
+    std::vector<int> order(n + 1);
+    order.at(0) = start;
+    order.at(n) = start;
+
+    if constexpr(Symmetry::symmetric) {
+        if(a > 0) {
+            const DpSet all = states - 1;
+            const uint64_t sets = binomial(m, b);
+            const uint64_t perTask = std::max(DP_MIN_SETS_PER_TASK,
+                sets / (uint64_t(pool.size()) * DP_TASKS_PER_THREAD) + 1);
+            const uint64_t tasks = (sets + perTask - 1) / perTask;
+
+            std::vector<DpHalves> found(tasks);
+            pool.parallelFor(tasks, [&](size_t task) {
+                uint64_t first = task * perTask;
+                DpSet second = unrankSet(first, b);
+                DpHalves best;
+                for(uint64_t s = 0; s < std::min(perTask, sets - first); ++s, second = nextSet(second)) {
+                    const int* firstCosts = &distances[rowOf(all ^ second) * m];
+                    const int* secondCosts = &distances[(layerRows[b] + first + s) * m];
+                    // the cities outside of the first half hold DP_INFINITY,
+                    // so the kernel finds the edge into each city of the
+                    // second one, as it does for the layers
+                    for(DpSet others = second; others != 0; others &= others - 1) {
+                        int other = std::countr_zero(others);
+                        DpMinimum edge = minimum(firstCosts, &columns[other * m], m);
+                        int cost = std::min(edge.cost, DP_INFINITY) + secondCosts[other];
+                        if(cost < best.cost) best = DpHalves{cost, second, edge.end, other};
+                    }
+                }
+                found[task] = best;
+            });
+
+            DpHalves best;
+            for(const DpHalves& halves : found) {
+                if(halves.cost < best.cost) best = halves;
+            }
+            if(best.cost >= DP_INFINITY) return DP_NO_TOUR;
+            readPath(all ^ best.second, best.firstEnd, &order[1]);
+            readPath(best.second, best.secondEnd, &order[a + 1]);
+            std::reverse(order.begin() + a + 1, order.begin() + n);
+            return TspSolution{order, best.cost};
+        }
     }
 
     // calculate the cost of the shortest path
 
-    // end state is all nodes visited, so all nodes up to n set
-    int endState = (1 << n) - 1;
+    // end state is all nodes visited, so all nodes up to m set
+    const DpSet endState = states - 1;
     int minTourCost = INT32_MAX;
+    int minEnd = 0;
 
-    for(int end = 0; end < n; ++end) {
-        if(end == start) continue;
-
+    for(int end = 0; end < m; ++end) {
         // we build final paths such as path ends at node `end`, for all nodes,
         // and we add edge "end -> start" at the end to complete the cycle
-        int tourCost = distances[end][endState]
-            + adjMatrix[index(end, start, n)];
+        int tourCost = distances[rowOf(endState) * m + end]
+            + dpWeight(adjMatrix, city(end), start);
 
-        if(tourCost < minTourCost) minTourCost = tourCost;
+        if(tourCost < minTourCost) {
+            minTourCost = tourCost;
+            minEnd = end;
+        }
     }
 
-    // construct the shortest path
+    if(minTourCost >= DP_INFINITY) return DP_NO_TOUR;
 
-    int lastIndex = start;
-    std::vector<int> order(n + 1);
-    int state = endState;
+    // construct the shortest path by walking backwards from the end state
+    // through the stored predecessors
+    readPath(endState, minEnd, &order[1]);
+
+    return TspSolution{order, minTourCost};
+}
+
+// cost of a path in `tspDpLayered`
+using DpCost = int32_t;
+
+// Calculates the solution using the dynamic programming approach, keeping only
+// the costs of two adjacent layers in memory. A layer holds every set of a
+// given size k, stored at the rank of the set, followed by the costs of paths
+// ending in each of its k cities in increasing order. This needs no space for
+// cities outside the set, and the layers that are done are thrown away, so for
+// n = 30 the costs take about 9 GB instead of the 60 GB of `tspDp`.
+// The predecessors of all the layers are kept to construct the tour. They take
+// (n - 1) * 2^(n - 2) bytes, which, if `spillPath` is not empty, are written
+// to a new file of that name mapped into memory, so that the kernel can move
+// finished layers out of RAM when it needs to. The file is only scratch space,
+// it's removed as soon as it's mapped (see MappedFile::createScratch). With
+// the Symmetric tag, only the layers up to half of the cities are computed
+// (see DpHalves), so the predecessors take less than half of that. Like
+// `tspDp`, it never takes a forbidden edge, and goes only over the allowed
+// arcs of a sparse instance.
+template <typename Symmetry = Asymmetric, typename Weight>
+TspSolution tspDpLayered(const DistanceMatrix<Weight>& adjMatrix, const int n,
+        int threads = 1, const std::string& spillPath = "") {
+    const int start = 0;
+    if(n < 2) {
+        return TspSolution{std::vector<int>(2, start), 0};
+    }
+
+    const int m = n - 1;
+    ThreadPool pool(threads);
+
+    // the city represented by a given bit position
+    auto city = [&](int bit) { return bit + 1; };
+
+    // the size of the sets of the last layer
+    const int b = Symmetry::symmetric && m >= 2 ? (m + 1) / 2 : m;
+    const int a = m - b;
+
+    // predecessors of layer k start at `layerOffsets[k]`
+    std::vector<uint64_t> layerOffsets(b + 2, 0);
+    for(int k = 1; k <= b; ++k) {
+        layerOffsets[k + 1] = layerOffsets[k] + binomial(m, k) * k;
+    }
+    const uint64_t predecessorsSize = layerOffsets[b + 1];
+
+    MappedFile spill;
+    std::vector<uint8_t> inMemory;
+    uint8_t* predecessors;
+    if(spillPath.empty()) {
+        inMemory.resize(predecessorsSize);
+        predecessors = inMemory.data();
+    }
+    else {
+        spill = MappedFile::createScratch(spillPath, predecessorsSize);
+        predecessors = spill.bytes();
+    }
+
+    // layer 1: direct paths from the start node to all the other nodes
+    std::vector<DpCost> previous(m);
+    for(int bit = 0; bit < m; ++bit) {
+        previous[bit] = dpWeight(adjMatrix, start, city(bit));
+        predecessors[layerOffsets[1] + bit] = DP_NO_PREDECESSOR;
+    }
+
+    // the matrix without the start city, column after column
+    std::vector<DpCost> columns(m * m);
+    for(int next = 0; next < m; ++next) {
+        for(int end = 0; end < m; ++end) {
+            columns[next * m + end] = dpWeight(adjMatrix, city(end), city(next));
+        }
+    }
+    const bool sparse = adjMatrix.allowedArcs().listed;
+    const std::vector<DpSet> arcsInto = sparse ? dpArcsInto(adjMatrix, n, start) : std::vector<DpSet>();
+
+    std::vector<DpCost> current;
+    // the costs of layer a, when it isn't the last one
+    std::vector<DpCost> firstLayer;
+    if(a == 1 && b > 1) firstLayer = previous;
+
+    // computes `count` consecutive sets of size k, starting from the one of
+    // rank `first`
+    auto computeSets = [&](int k, uint64_t first, uint64_t count) {
+        uint8_t* layerPredecessors = predecessors + layerOffsets[k];
+        DpSet set = unrankSet(first, k);
 
-    // walk backwards from the end state, to find the previous node
-    for(int i = n - 1; i >= 1; --i) {
-        int bestIndex = -1;
+        int cities[64];
+        uint64_t previousRanks[64];
 
-        // starting from the end of the cycle (starting node) t = s we find
-        // previous node p such as path: s -> ... -> p -> t is the shortest.
-        // once we find it, we set t = p and repeat until we have reached the
-        // starting node again
-        for(int j = 0; j < n; ++j) {
-            if(j == start || !setContains(state, j)) continue;
+        for(uint64_t rank = first; rank < first + count; ++rank, set = nextSet(set)) {
+            int size = 0;
+            for(DpSet s = set; s != 0; s &= s - 1) {
+                cities[size++] = std::countr_zero(s);
+            }
+            ranksWithout(cities, k, previousRanks);
 
-            if(bestIndex == -1) bestIndex = j;
+            DpCost* costs = &current[rank * k];
+            uint8_t* predecessorsOfSet = &layerPredecessors[rank * k];
 
-            int prevDist = distances[bestIndex][state]
-                + adjMatrix[index(bestIndex, lastIndex, n)];
+            for(int j = 0; j < k; ++j) {
+                int next = cities[j];
+                const DpCost* previousCosts = &previous[previousRanks[j] * (k - 1)];
 
-            int newDist = distances[j][state]
-                + adjMatrix[index(j, lastIndex, n)];
+                const DpCost* column = &columns[next * m];
+                DpCost minDistance = DP_INFINITY;
+                int minEnd = 0;
 
-            // if path s -> ... -> j -> lastIndex is shorter, update bestIndex
-            if(newDist < prevDist) bestIndex = j;
+                if(sparse) {
+                    // the position of a city in the smaller set is the
+                    // number of its cities before it
+                    DpSet previousSet = set & ~(DpSet(1) << next);
+                    for(DpSet ends = previousSet & arcsInto[next]; ends != 0; ends &= ends - 1) {
+                        int end = std::countr_zero(ends);
+                        DpCost newDistance = previousCosts[std::popcount(previousSet & ((DpSet(1) << end) - 1))]
+                            + column[end];
+                        if(newDistance < minDistance) {
+                            minDistance = newDistance;
+                            minEnd = end;
+                        }
+                    }
+                }
+                else {
+                    // the cities of the smaller set are the ones of this set
+                    // without the j-th one, in the same order
+                    for(int i = 0; i < k - 1; ++i) {
+                        int end = cities[i < j ? i : i + 1];
+                        DpCost newDistance = previousCosts[i] + column[end];
+                        if(newDistance < minDistance) {
+                            minDistance = newDistance;
+                            minEnd = end;
+                        }
+                    }
+                }
+                costs[j] = minDistance;
+                predecessorsOfSet[j] = minEnd;
+            }
         }
+    };
+
+    for(int k = 2; k <= b; ++k) {
+        const uint64_t sets = binomial(m, k);
+        current.resize(sets * k);
+
+        const uint64_t perTask = std::max(DP_MIN_SETS_PER_TASK,
+            sets / (uint64_t(pool.size()) * DP_TASKS_PER_THREAD) + 1);
+        const uint64_t tasks = (sets + perTask - 1) / perTask;
+
+        pool.parallelFor(tasks, [&](size_t task) {
+            uint64_t first = task * perTask;
+            computeSets(k, first, std::min(perTask, sets - first));
+        });
 
-        order.at(i) = bestIndex;
-        state &= ~(1 << bestIndex);
-        lastIndex = bestIndex;
+        if(!spillPath.empty()) {
+            spill.release(layerOffsets[k], layerOffsets[k + 1] - layerOffsets[k]);
+        }
+
+        std::swap(previous, current);
+        // free the memory of the layer before, instead of keeping the
+        // capacity of the larger one of the two around
+        std::vector<DpCost>().swap(current);
+        if(k == a && a < b) firstLayer = previous;
     }
 
+    // writes the cities of the shortest path through `state` ending in `bit`
+    // to `path`, in the order they're visited
+    auto readPath = [&](DpSet state, int bit, int* path) {
+        for(int k = std::popcount(state); k >= 1; --k) {
+            path[k - 1] = city(bit);
+            int position = std::popcount(state & ((DpSet(1) << bit) - 1));
+            int previousBit = predecessors[layerOffsets[k] + rankSet(state) * k + position];
+            state &= ~(DpSet(1) << bit);
+            bit = previousBit;
+        }
+    };
+
+    std::vector<int> order(n + 1);
     order.at(0) = start;
     order.at(n) = start;
 
+    if constexpr(Symmetry::symmetric) {
+        if(a > 0) {
+            const DpSet all = (DpSet(1) << m) - 1;
+            const std::vector<DpCost>& firstCosts = a == b ? previous : firstLayer;
+            const uint64_t sets = binomial(m, b);
+            const uint64_t perTask = std::max(DP_MIN_SETS_PER_TASK,
+                sets / (uint64_t(pool.size()) * DP_TASKS_PER_THREAD) + 1);
+            const uint64_t tasks = (sets + perTask - 1) / perTask;
+
+            std::vector<DpHalves> found(tasks);
+            pool.parallelFor(tasks, [&](size_t task) {
+                uint64_t first = task * perTask;
+                DpSet second = unrankSet(first, b);
+                DpHalves best;
+                int ends[64];
+                int others[64];
+                for(uint64_t rank = first; rank < first + std::min(perTask, sets - first);
+                        ++rank, second = nextSet(second)) {
+                    // the costs of both layers are stored in the order of
+                    // the cities of the set
+                    const DpCost* costs = &firstCosts[rankSet(all ^ second) * a];
+                    const DpCost* otherCosts = &previous[rank * b];
+                    int size = 0;
+                    for(DpSet s = all ^ second; s != 0; s &= s - 1) ends[size++] = std::countr_zero(s);
+                    size = 0;
+                    for(DpSet s = second; s != 0; s &= s - 1) others[size++] = std::countr_zero(s);
+
+                    for(int i = 0; i < a; ++i) {
+                        for(int j = 0; j < b; ++j) {
+                            DpCost cost = std::min(costs[i] + columns[others[j] * m + ends[i]], DP_INFINITY)
+                                + otherCosts[j];
+                            if(cost < best.cost) best = DpHalves{cost, second, ends[i], others[j]};
+                        }
+                    }
+                }
+                found[task] = best;
+            });
+
+            DpHalves best;
+            for(const DpHalves& halves : found) {
+                if(halves.cost < best.cost) best = halves;
+            }
+            if(best.cost >= DP_INFINITY) return DP_NO_TOUR;
+            readPath(all ^ best.second, best.firstEnd, &order[1]);
+            readPath(best.second, best.secondEnd, &order[a + 1]);
+            std::reverse(order.begin() + a + 1, order.begin() + n);
+            return TspSolution{order, best.cost};
+        }
+    }
+
+    // the last layer holds the single set of all the cities
+    DpCost minTourCost = INT32_MAX;
+    int minEnd = 0;
+    for(int end = 0; end < m; ++end) {
+        DpCost tourCost = previous[end] + dpWeight(adjMatrix, city(end), start);
+        if(tourCost < minTourCost) {
+            minTourCost = tourCost;
+            minEnd = end;
+        }
+    }
+
+    if(minTourCost >= DP_INFINITY) return DP_NO_TOUR;
+
+    // walk backwards from the end state through the stored predecessors
+    readPath((DpSet(1) << m) - 1, minEnd, &order[1]);
+
     return TspSolution{order, minTourCost};
 }
@@ -2,43 +2,174 @@
 
 #include <chrono>
 #include <random>
+#include <numeric>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <optional>
 
 #include "tspsolver.cpp"
+#include "crossover.cpp"
+#include "local_search.cpp"
+#include "selection.cpp"
+#include "heuristic_tour.cpp"
+#include "thread_pool.cpp"
 #include "lib.h"
 
 namespace chrono = std::chrono;
 
-class GaTspSolver : public TspSolver {
+// which islands of the island model send their best tours to which
+enum class GaTopology {
+    // each island to the next one
+    Ring,
+    // each island to all the others
+    Full,
+};
+
+struct GaIslandOptions {
+    // number of populations evolving at the same time
+    int islands = 1;
+    // threads evolving them, 0 means all hardware threads
+    int threads = 0;
+    GaTopology topology = GaTopology::Ring;
+    // an island sends its best tours to its neighbours every that many
+    // generations, 0 means the islands never exchange anything
+    int migrationInterval = 50;
+    int migrants = 2;
+};
+
+struct GaOptions {
+    GaCrossover crossover = GaCrossover::Swap;
+    GaSelection selection = GaSelection::Roulette;
+    // number of tours taking part in each tournament
+    int tournamentSize = 3;
+    int populationSize = 64;
+    // largest number of generations of each island. A run with the same
+    // seed that ends by reaching it gives the same result, unless its
+    // islands migrate, as then it depends on which one gets ahead.
+    long generations = 10000000;
+    // share of the children improved with local search, 0 turns it off
+    double memeticShare = 0;
+    // share of the first population made of nearest neighbour tours (see
+    // generateGreedySolution), the rest of it is random
+    double greedyShare = 0.25;
+    GaIslandOptions islands;
+};
+
+// With the Symmetric tag, the local search of a memetic run also puts
+// segments back reversed (see LocalSearch).
+template <typename Instance, typename Symmetry = Asymmetric>
+class GaTspSolver : public TspSolver<Instance> {
 private:
-    struct Chromosome {
-        std::vector<int> order;
-        std::vector<int> pathCost;
-        std::vector<int> notUsed;
-        int cost = 0;
+    using TspSolver<Instance>::getTsp;
+    using TspSolver<Instance>::rng;
+    using Distances = typename Instance::Distances;
+
+    // All the tours of a generation, one after another in a single buffer,
+    // with their costs kept apart. Two of them are allocated once per run:
+    // the children are written into the one not holding the parents, and then
+    // the two are swapped, so that no generation allocates anything.
+    struct Population {
+        int citiesNumber = 0;
+        std::vector<int> genes;
+        std::vector<int64_t> costs;
+
+        Population(int size, int _citiesNumber) :
+            citiesNumber(_citiesNumber),
+            genes(size_t(size) * _citiesNumber),
+            costs(size) {}
+
+        int size() const { return costs.size(); }
+        int* tour(int i) { return &genes[size_t(i) * citiesNumber]; }
+        const int* tour(int i) const { return &genes[size_t(i) * citiesNumber]; }
+    };
+
+    // One population of the island model, with everything needed to evolve
+    // it. A thread evolves an island only while holding `busy`, so the
+    // islands can be picked up by whichever thread is free.
+    struct Island {
+        Population population;
+        Population newPopulation;
+        Crossover<Distances> crossover;
+        Selection selection;
+        // improves a share of the children, if the run is memetic
+        std::optional<LocalSearch<Distances, Symmetry>> localSearch;
+        Rng rng;
+        int64_t bestCost = INT64_MAX;
+        std::vector<int> bestPath;
+        long generations = 0;
+        chrono::steady_clock::duration localSearchTime{};
+        // the tours of the population ordered by cost, used for migration
+        std::vector<int> ranking;
+        std::atomic<bool> busy{false};
+
+        Island(int size, int citiesNumber, const Distances& adjMatrix, const GaOptions& options,
+                const NeighbourLists& candidates, const Rng& _rng) :
+            population(size, citiesNumber),
+            newPopulation(size, citiesNumber),
+            crossover(adjMatrix, citiesNumber, options.crossover, candidates),
+            selection(options.selection, size, options.tournamentSize),
+            rng(_rng),
+            bestPath(citiesNumber),
+            ranking(size)
+        {
+            if (options.memeticShare > 0) localSearch.emplace(adjMatrix, citiesNumber, candidates);
+        }
+    };
+
+    // Tours sent from one island to another. It holds a single batch: the
+    // sender only writes it while `full` is false, and the receiver only
+    // reads it while it is true, so neither of them ever waits. A batch sent
+    // while the previous one hasn't been taken is dropped.
+    struct Mailbox {
+        std::atomic<bool> full{false};
+        Population migrants;
+
+        Mailbox(int size, int citiesNumber) : migrants(size, citiesNumber) {}
     };
 
     struct GaParameters {
         double mutationFactor, crossoverFactor;
-        int generations, population_size;
+        long generations;
+        int population_size;
     } parameters;
 
-    int bestCost = INT32_MAX;
+    GaOptions options;
+
+    int64_t bestCost = INT64_MAX;
     std::vector<int> bestFoundPath;
-    int iterations = 0;
+    // whether the instance has forbidden edges, so that the children have to
+    // be checked for them
+    bool forbidding = false;
+    int generations = 0;
     long int tookTime = 0;
+    double localSearchSeconds = 0;
 
 public:
-    GaTspSolver(const Tsp& instance) : TspSolver(instance) {
+    GaTspSolver(const Instance& instance, const GaOptions& _options = {}) :
+        TspSolver<Instance>(instance), options(_options)
+    {
         parameters.crossoverFactor = 0.8;
         parameters.mutationFactor = 0.01;
-        parameters.population_size = 64;
-        parameters.generations = 10000000;
+        parameters.population_size = std::max(2, options.populationSize);
+        parameters.generations = options.generations;
+    }
+
+    // number of generations the last call to `solve` went through, summed
+    // over the islands
+    int getGenerations() const {
+        return generations;
+    }
+
+    // time the last call to `solve` spent improving children with local
+    // search, summed over the islands
+    double getLocalSearchSeconds() const {
+        return localSearchSeconds;
     }
 
     TspSolution solve(int startCity, float timeoutS) override {
-        Tsp tsp = getTsp();
-        std::vector<int> adjMatrix = tsp.getAdjMatrix();
-        int citiesNumber = tsp.size();
+        const Distances& adjMatrix = getTsp().getAdjMatrix();
+        int citiesNumber = adjMatrix.size();
 
         auto start = chrono::high_resolution_clock::now();
         auto end = chrono::high_resolution_clock::now();
@@ -47,201 +178,313 @@ public:
 
         std::ofstream f("costs.csv");
 
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> realDist(0.0, 1.0);
-        std::uniform_int_distribution<> randGenome(0, parameters.population_size - 1);
-
-        std::vector<Chromosome> population;
-        Chromosome tempGenome;
-        int generation = 1;
-
-        for (int i = 0; i < parameters.population_size; i++) {
-            tempGenome = generateSolution(adjMatrix, citiesNumber);
-            population.push_back(tempGenome);
-        }
-
-        do {
-            std::vector<Chromosome> newPopulation;
+        const NeighbourLists& candidates = getTsp().candidates();
+        forbidding = getTsp().hasForbiddenEdges();
 
+        int islandsNumber = std::max(1, options.islands.islands);
+        std::vector<std::unique_ptr<Island>> islands;
+        for (int k = 0; k < islandsNumber; k++) {
+            islands.push_back(std::make_unique<Island>(parameters.population_size, citiesNumber,
+                adjMatrix, options, candidates, rng(k)));
+            Island& island = *islands.back();
+            Population& population = island.population;
+            int greedy = options.greedyShare * population.size();
+            // with forbidden edges, the tours are found along the allowed
+            // arcs, and the ones that weren't found are copies of those that
+            // were
+            std::vector<int> found;
             for (int i = 0; i < population.size(); i++) {
-                f << population[i].cost << "\n";
+                if (forbidding) {
+                    if (tourAlongArcs(adjMatrix, citiesNumber, 0, island.rng, i < greedy, population.tour(i))) {
+                        found.push_back(i);
+                    }
+                }
+                else if (i < greedy) generateGreedySolution(candidates, population.tour(i), citiesNumber, island);
+                else generateSolution(population.tour(i), citiesNumber, island);
             }
-
-            for (int i = 0; i < parameters.population_size / 2; i++) {
-                iterations++;
-                Chromosome parent1 = selectParent(population);
-                Chromosome parent2 = selectParent(population);
-                Chromosome child1;
-                Chromosome child2;
-
-                if (realDist(gen) <= parameters.crossoverFactor) {
-                    child1 = crossover(parent1, parent2, citiesNumber);
-                    child2 = crossover(parent2, parent1, citiesNumber);
+            if (forbidding && found.empty()) return TspSolution{{0, 0}, INT32_MAX};
+            for (int i = 0, nextFound = 0; forbidding && i < population.size(); i++) {
+                if (nextFound < int(found.size()) && found[nextFound] == i) {
+                    nextFound++;
+                    continue;
                 }
-                else {
-                    child1 = parent1;
-                    child2 = parent2;
+                const int* tour = population.tour(found[i % found.size()]);
+                std::copy(tour, tour + citiesNumber, population.tour(i));
+            }
+            getTsp().tourCosts(population.genes.data(), population.size(), citiesNumber, true, population.costs.data());
+            for (int i = 0; i < population.size(); i++) {
+                if (island.bestCost > population.costs[i]) {
+                    std::copy(population.tour(i), population.tour(i) + citiesNumber, island.bestPath.begin());
+                    island.bestCost = population.costs[i];
                 }
+            }
+        }
 
-                if (realDist(gen) <= parameters.mutationFactor) {
-                    child1 = transpositionMutation(child1, citiesNumber);
-                    child2 = transpositionMutation(child2, citiesNumber);
+        if (islandsNumber == 1) {
+            Island& island = *islands[0];
+            do {
+                for (int i = 0; i < island.population.size(); i++) {
+                    f << island.population.costs[i] << "\n";
                 }
 
-                child1.cost = calculateCost(adjMatrix, child1, citiesNumber);
-                child2.cost = calculateCost(adjMatrix, child2, citiesNumber);
-
-                newPopulation.push_back(child1);
-                newPopulation.push_back(child2);
-
-                if (bestCost > child1.cost) {
-                    bestFoundPath = child1.order;
-                    bestCost = child1.cost;
-                }
-                if (bestCost > child2.cost) {
-                    bestFoundPath = child2.order;
-                    bestCost = child2.cost;
-                }
-            }
-            population = newPopulation;
-            generation++;
+                evolve(citiesNumber, island);
+                end = std::chrono::high_resolution_clock::now();
+                time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+                timeS = (float)time.count() / 1000.0;
+            } while (timeS < timeoutS && island.generations < parameters.generations);
+        }
+        else {
+            evolveIslands(citiesNumber, islands, start + chrono::milliseconds(long(timeoutS * 1000)), f);
             end = std::chrono::high_resolution_clock::now();
             time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-            timeS = (float)time.count() / 1000.0;
-        } while (timeS < timeoutS && generation < parameters.generations);
+        }
         tookTime = time.count();
 
+        generations = 0;
+        localSearchSeconds = 0;
+        for (auto& island : islands) {
+            generations += island->generations;
+            localSearchSeconds += chrono::duration<double>(island->localSearchTime).count();
+            if (bestCost > island->bestCost) {
+                bestCost = island->bestCost;
+                bestFoundPath = island->bestPath;
+            }
+        }
+
         return TspSolution{bestFoundPath, bestCost};
     }
 
-    int calculateCost(std::vector<int> adjMatrix, Chromosome& solution, int citiesNumber) {
-        int cost = 0;
-        solution.pathCost[citiesNumber - 1] = adjMatrix[solution.order[citiesNumber - 1] * citiesNumber + solution.order[0]];
-        cost += solution.pathCost[citiesNumber - 1];
-        for (int i = 0; i < citiesNumber - 1; i++) {
-            solution.pathCost[i] = adjMatrix[solution.order[i] * citiesNumber + solution.order[i + 1]];
-            cost += solution.pathCost[i];
-        }
-        return cost;
-    }
+    // makes the next generation of the island
+    void evolve(int citiesNumber, Island& island) {
+        Population& population = island.population;
+        Population& newPopulation = island.newPopulation;
+        Rng& rng = island.rng;
+
+        island.selection.prepare(population.costs);
+        for (int i = 0; i < population.size(); i += 2) {
+            const int* parent1 = population.tour(island.selection.pick(rng));
+            const int* parent2 = population.tour(island.selection.pick(rng));
+            // the second child doesn't fit into a population of odd size
+            int children = std::min(2, population.size() - i);
+
+            int* child1 = newPopulation.tour(i);
+            int* child2 = children == 2 ? newPopulation.tour(i + 1) : nullptr;
+
+            if (rng.uniform() <= parameters.crossoverFactor) {
+                island.crossover(parent1, parent2, child1, rng);
+                if (child2) island.crossover(parent2, parent1, child2, rng);
 
-    Chromosome selectParent(std::vector<Chromosome> population) {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> realDist(0.0, 1.0);
-        int bestIndex = 0, worstInPop = 0, bestInPop = INT32_MAX;
-        for (int i = 0; i < population.size(); i++) {
-            if (population[i].cost < bestInPop) {
-                bestIndex = i;
-                bestInPop = population[i].cost;
+                // a child that takes a forbidden edge is no tour, so it's
+                // replaced with the parent its crossover started from
+                if (forbidding && !feasible(child1, citiesNumber)) std::copy(parent1, parent1 + citiesNumber, child1);
+                if (child2 && forbidding && !feasible(child2, citiesNumber)) {
+                    std::copy(parent2, parent2 + citiesNumber, child2);
+                }
+            }
+            else {
+                std::copy(parent1, parent1 + citiesNumber, child1);
+                if (child2) std::copy(parent2, parent2 + citiesNumber, child2);
             }
-            if (population[i].cost > worstInPop) {
-                worstInPop = population[i].cost;
+
+            if (rng.uniform() <= parameters.mutationFactor) {
+                transpositionMutation(child1, citiesNumber, rng);
+                if (child2) transpositionMutation(child2, citiesNumber, rng);
             }
         }
-        int diff = worstInPop - bestInPop;
-        for (int i = 0; i < population.size(); i++) {
-            double selectionChance = ((double)worstInPop - population[i].cost) / (double)diff;
-            if (selectionChance >= 1.0) {
-                selectionChance -= 0.1;
+
+        // the whole generation is scored at once
+        getTsp().tourCosts(newPopulation.genes.data(), newPopulation.size(), citiesNumber, true,
+            newPopulation.costs.data());
+        for (int c = 0; c < newPopulation.size(); c++) {
+            int64_t& cost = newPopulation.costs[c];
+            if (island.localSearch && rng.uniform() < options.memeticShare) {
+                auto localSearchStart = chrono::steady_clock::now();
+                cost -= island.localSearch->improve(newPopulation.tour(c));
+                island.localSearchTime += chrono::steady_clock::now() - localSearchStart;
             }
-            if (realDist(gen) <= selectionChance) {
-                return population[i];
+            if (island.bestCost > cost) {
+                std::copy(newPopulation.tour(c), newPopulation.tour(c) + citiesNumber, island.bestPath.begin());
+                island.bestCost = cost;
             }
         }
-        return population[bestIndex];
+        std::swap(population, newPopulation);
+        island.generations++;
     }
 
-    Chromosome crossover(Chromosome parent1, Chromosome parent2, int citiesNumber) {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> randCity(citiesNumber / 4, citiesNumber - (citiesNumber / 4));
-        Chromosome child;
-        int breakpoint = randCity(gen);
-        int temp = 0;
-        for (int i = 0; i < breakpoint; i++) {
-            temp = parent1.order[i];
-            for (int j = 0; j < parent2.order.size(); j++) {
-                if (temp == parent2.order[j]) {
-                    parent2.order[j] = parent2.order[i];
-                    parent2.order[i] = temp;
+    // Evolves the islands on a thread pool until the deadline. Each thread
+    // goes around the islands, starting from a different one, and evolves a
+    // generation of every island that no other thread is evolving at the
+    // moment. Every `migrationInterval` generations an island sends its best
+    // tours to the mailboxes of its neighbours, and before each generation it
+    // swaps the tours waiting in its own mailboxes for its worst ones.
+    void evolveIslands(int citiesNumber, std::vector<std::unique_ptr<Island>>& islands,
+            chrono::high_resolution_clock::time_point deadline, std::ofstream& f) {
+        const int islandsNumber = islands.size();
+        const int migrants = std::clamp(options.islands.migrants, 1, parameters.population_size);
+        const bool migrating = options.islands.migrationInterval > 0;
+
+        // the mailbox from island `from` to island `to` is at to * islands + from
+        std::vector<std::unique_ptr<Mailbox>> mailboxes(islandsNumber * islandsNumber);
+        auto sendsTo = [&](int from, int to) {
+            if (!migrating || from == to) return false;
+            return options.islands.topology == GaTopology::Full || to == (from + 1) % islandsNumber;
+        };
+        for (int from = 0; from < islandsNumber; from++) {
+            for (int to = 0; to < islandsNumber; to++) {
+                if (sendsTo(from, to)) {
+                    mailboxes[to * islandsNumber + from] = std::make_unique<Mailbox>(migrants, citiesNumber);
                 }
             }
         }
-        child = parent2;
-        return child;
+
+        // the cheapest cost found by any of the islands
+        std::atomic<int64_t> globalBest{INT64_MAX};
+
+        auto rank = [&](Island& island) {
+            const Population& population = island.population;
+            std::iota(island.ranking.begin(), island.ranking.end(), 0);
+            std::nth_element(island.ranking.begin(), island.ranking.begin() + migrants - 1, island.ranking.end(),
+                [&](int a, int b) { return population.costs[a] < population.costs[b]; });
+        };
+
+        auto receive = [&](int to) {
+            Island& island = *islands[to];
+            for (int from = 0; from < islandsNumber; from++) {
+                Mailbox* mailbox = mailboxes[to * islandsNumber + from].get();
+                if (!mailbox || !mailbox->full.load(std::memory_order_acquire)) continue;
+
+                // the worst tours are the last ones of the reversed ranking
+                Population& population = island.population;
+                std::iota(island.ranking.begin(), island.ranking.end(), 0);
+                std::nth_element(island.ranking.begin(), island.ranking.begin() + migrants - 1, island.ranking.end(),
+                    [&](int a, int b) { return population.costs[a] > population.costs[b]; });
+                for (int m = 0; m < migrants; m++) {
+                    int worst = island.ranking[m];
+                    const int* tour = mailbox->migrants.tour(m);
+                    std::copy(tour, tour + citiesNumber, population.tour(worst));
+                    population.costs[worst] = mailbox->migrants.costs[m];
+                }
+                mailbox->full.store(false, std::memory_order_release);
+            }
+        };
+
+        auto send = [&](int from) {
+            Island& island = *islands[from];
+            rank(island);
+            for (int to = 0; to < islandsNumber; to++) {
+                Mailbox* mailbox = mailboxes[to * islandsNumber + from].get();
+                if (!mailbox || mailbox->full.load(std::memory_order_acquire)) continue;
+
+                for (int m = 0; m < migrants; m++) {
+                    int best = island.ranking[m];
+                    const int* tour = island.population.tour(best);
+                    std::copy(tour, tour + citiesNumber, mailbox->migrants.tour(m));
+                    mailbox->migrants.costs[m] = island.population.costs[best];
+                }
+                mailbox->full.store(true, std::memory_order_release);
+            }
+        };
+
+        // islands that went through all their generations
+        std::atomic<int> finished{0};
+
+        ThreadPool pool(options.islands.threads);
+        const int threads = pool.size();
+        pool.parallelFor(threads, [&](size_t thread) {
+            for (int k = thread % islandsNumber;
+                    finished.load(std::memory_order_relaxed) < islandsNumber && chrono::high_resolution_clock::now() < deadline;
+                    k = (k + 1) % islandsNumber) {
+                Island& island = *islands[k];
+                if (island.busy.exchange(true, std::memory_order_acquire)) continue;
+                if (island.generations >= parameters.generations) {
+                    island.busy.store(false, std::memory_order_release);
+                    continue;
+                }
+
+                if (migrating) receive(k);
+                evolve(citiesNumber, island);
+                if (migrating && island.generations % options.islands.migrationInterval == 0) send(k);
+                if (island.generations == parameters.generations) finished++;
+
+                int64_t best = globalBest.load(std::memory_order_relaxed);
+                while (island.bestCost < best && !globalBest.compare_exchange_weak(best, island.bestCost)) {}
+                // only one thread at a time evolves the first island
+                if (k == 0) f << globalBest.load(std::memory_order_relaxed) << "\n";
+
+                island.busy.store(false, std::memory_order_release);
+            }
+        });
+    }
+
+    // whether the tour takes no forbidden edge
+    bool feasible(const int* solution, int citiesNumber) const {
+        const Distances& adjMatrix = getTsp().getAdjMatrix();
+        for (int i = 0; i < citiesNumber; i++) {
+            if (adjMatrix.forbidden(solution[i], solution[(i + 1) % citiesNumber])) return false;
+        }
+        return true;
     }
 
-    Chromosome transpositionMutation(Chromosome solution, int citiesNumber) {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> randCity(0, citiesNumber - 1);
-        int randIndex1 = randCity(gen);
-        int randIndex2 = randCity(gen);
+    // swaps two random cities, unless that makes the tour take a forbidden
+    // edge
+    void transpositionMutation(int* solution, int citiesNumber, Rng& rng) {
+        int randIndex1 = rng.below(citiesNumber);
+        int randIndex2 = rng.below(citiesNumber);
         while (randIndex1 == randIndex2)
-            randIndex2 = randCity(gen);
-        int temp = solution.order[randIndex1];
-        solution.order[randIndex1] = solution.order[randIndex2];
-        solution.order[randIndex2] = temp;
-        return solution;
+            randIndex2 = rng.below(citiesNumber);
+        std::swap(solution[randIndex1], solution[randIndex2]);
+        if (forbidding && !feasible(solution, citiesNumber)) std::swap(solution[randIndex1], solution[randIndex2]);
     }
 
-    Chromosome insertionMutation(Chromosome solution, int citiesNumber) {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> randCity(0, citiesNumber - 1);
-        int randIndex1 = randCity(gen);
-        int randIndex2 = randCity(gen);
+    void insertionMutation(int* solution, int citiesNumber, Rng& rng) {
+        int randIndex1 = rng.below(citiesNumber);
+        int randIndex2 = rng.below(citiesNumber);
         while (randIndex1 == randIndex2)
-            randIndex2 = randCity(gen);
-        int temp = solution.order[randIndex1];
-        solution.order.erase(solution.order.begin() + randIndex1);
-        solution.order.insert(solution.order.begin() + randIndex2, temp);
-        return solution;
+            randIndex2 = rng.below(citiesNumber);
+        // move the city at randIndex1 to randIndex2, shifting the ones between
+        if (randIndex1 < randIndex2)
+            std::rotate(solution + randIndex1, solution + randIndex1 + 1, solution + randIndex2 + 1);
+        else
+            std::rotate(solution + randIndex2, solution + randIndex1, solution + randIndex1 + 1);
     }
 
-    Chromosome generateSolution(std::vector<int> adjMatrix, int citiesNumber) {
-        Chromosome genome;
-        genome.order.resize(citiesNumber);
-        genome.pathCost.resize(citiesNumber);
-        genome.order[0] = 0;
-        int temp = 0, randIndex;
-        std::random_device rd;
-        std::mt19937 gen(rd());
-
-        for (int i = 0; i < citiesNumber - 1; i++) {
-            bool isUsed = false;
-            genome.notUsed.clear();
-            // check which cities have not been visited yet
-            for (int k = 0; k < citiesNumber; k++) {
-                isUsed = false;
-                for (int j = 0; j < genome.order.size(); j++) {
-                    if (genome.order.at(j) == k) {
-                        isUsed = true;
-                        break;
-                    }
-                }
-                if (!isUsed) {
-                    genome.notUsed.push_back(k);
-                }
-            }
+    // writes a random tour starting from city 0 to `genome`
+    void generateSolution(int* genome, int citiesNumber, Island& island) {
+        std::iota(genome, genome + citiesNumber, 0);
+        std::shuffle(genome + 1, genome + citiesNumber, island.rng);
+    }
 
-            // Wybieranie sciezki losowo
-            std::uniform_int_distribution<> randCity(0, genome.notUsed.size() - 1);
-            randIndex = randCity(gen);
-            temp = adjMatrix.at(genome.order.at(i) * citiesNumber + genome.notUsed.at(randIndex));
-            genome.order.at(i + 1) = genome.notUsed.at(randIndex);
-            genome.pathCost.at(i) = temp;
-            genome.cost += genome.pathCost.at(i);
-        }
-        genome.pathCost.at(citiesNumber - 1) = adjMatrix.at(genome.order.at(citiesNumber - 1) * citiesNumber + genome.order.at(0));
-        genome.cost += genome.pathCost.at(citiesNumber - 1);
-        if (bestCost > genome.cost) {
-            bestFoundPath = genome.order;
-            bestCost = genome.cost;
-        }
+    // Writes a nearest neighbour tour to `genome`, built from a random city
+    // along the candidate lists, and rotated to start from city 0. A city
+    // whose candidates have all been visited goes to a random unvisited one.
+    void generateGreedySolution(const NeighbourLists& candidates, int* genome, int citiesNumber, Island& island) {
+        // the unvisited cities are the first `left` of `notUsed`, and
+        // slot[c] is where city c is in it
+        std::vector<int> notUsed(citiesNumber), slot(citiesNumber);
+        std::iota(notUsed.begin(), notUsed.end(), 0);
+        std::iota(slot.begin(), slot.end(), 0);
+        int left = citiesNumber;
+        auto visit = [&](int city) {
+            int last = notUsed[--left];
+            notUsed[slot[city]] = last;
+            slot[last] = slot[city];
+            notUsed[left] = city;
+            slot[city] = left;
+        };
+
+        int city = island.rng.below(citiesNumber);
+        for (int i = 0; i < citiesNumber; i++) {
+            genome[i] = city;
+            visit(city);
+            if (left == 0) break;
 
-        return genome;
+            int next = -1;
+            for (int k = 0; k < candidates.k && next == -1; k++) {
+                int candidate = candidates.out[city * candidates.k + k];
+                if (slot[candidate] < left) next = candidate;
+            }
+            city = next != -1 ? next : notUsed[island.rng.below(left)];
+        }
+        std::rotate(genome, std::find(genome, genome + citiesNumber, 0), genome + citiesNumber);
     }
 };
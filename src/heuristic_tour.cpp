@@ -0,0 +1,268 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+#include "lib.h"
+#include "rng.cpp"
+
+// Quick heuristics that find a good, but not necessarily optimal, tour. The
+// exact solvers use them to start with a known upper bound.
+
+// cost of an edge, with the forbidden ones made so expensive that they are
+// never chosen
+template <typename Weight>
+int64_t heuristicEdge(const DistanceMatrix<Weight>& adjMatrix, int from, int to) {
+    return adjMatrix.forbidden(from, to) ? INT32_MAX : adjMatrix(from, to);
+}
+
+// Builds a tour starting in `start` by always going to the nearest city not
+// visited yet. Returns the n cities in order, without going back to the start.
+template <typename Weight>
+std::vector<int> nearestNeighbourTour(const DistanceMatrix<Weight>& adjMatrix, int n, int start) {
+    std::vector<int> order{start};
+    std::vector<bool> visited(n, false);
+    visited[start] = true;
+
+    for(int step = 1; step < n; ++step) {
+        int from = order.back();
+        int nearest = -1;
+        for(int to = 0; to < n; ++to) {
+            if(visited[to]) continue;
+            if(nearest == -1 || heuristicEdge(adjMatrix, from, to) < heuristicEdge(adjMatrix, from, nearest)) {
+                nearest = to;
+            }
+        }
+        visited[nearest] = true;
+        order.push_back(nearest);
+    }
+    return order;
+}
+
+// attempts of tourAlongArcs, and the steps each of them may take per city
+const int ARC_TOUR_ATTEMPTS = 8;
+const int ARC_TOUR_STEPS_PER_CITY = 32;
+
+// Looks for a tour of the n cities from `start` that takes no forbidden edge,
+// with a depth first search along the allowed arcs. A city that only the last
+// one of the path can still go to has to come next, and two of them mean the
+// path is a dead end. Otherwise it goes on to the unvisited city with the
+// fewest unvisited cities left to go to from it (Warnsdorff's rule), as that
+// one is the most likely to be cut off later, and between equal ones to the
+// nearest one if `nearestFirst`, or to a random one. It backs up when it's
+// stuck, and starts over, with random choices, after ARC_TOUR_STEPS_PER_CITY
+// * n steps, up to ARC_TOUR_ATTEMPTS times. Writes the cities in order,
+// without going back to the start, to `tour` and returns whether it found one.
+template <typename Distances>
+bool tourAlongArcs(const Distances& adjMatrix, int n, int start, Rng& rng, bool nearestFirst, int* tour) {
+    tour[0] = start;
+    if(n == 1) return true;
+
+    // instances without lists of allowed arcs have all of their rows scanned
+    const AllowedArcs* arcs = nullptr;
+    if constexpr(requires { adjMatrix.allowedArcs(); }) {
+        if(!adjMatrix.allowedArcs().everyCityLinked) return false;
+        if(adjMatrix.allowedArcs().listed) arcs = &adjMatrix.allowedArcs();
+    }
+    auto forEachOut = [&](int from, auto&& f) {
+        if(arcs) {
+            for(int to : arcs->out(from)) f(to);
+            return;
+        }
+        for(int to = 0; to < n; ++to) {
+            if(!adjMatrix.forbidden(from, to)) f(to);
+        }
+    };
+    auto forEachIn = [&](int to, auto&& f) {
+        if(arcs) {
+            for(int from : arcs->in(to)) f(from);
+            return;
+        }
+        for(int from = 0; from < n; ++from) {
+            if(!adjMatrix.forbidden(from, to)) f(from);
+        }
+    };
+
+    std::vector<bool> visited(n, false);
+    // freeOut[c] is the number of unvisited cities that c can go to, and
+    // freeIn[c] the number of the ones that can go to c, counting the last
+    // city of the path, which the start has to be gone back to from
+    std::vector<int> freeOut(n, 0), freeIn(n, 0);
+    for(int city = 0; city < n; ++city) {
+        forEachOut(city, [&](int to) {
+            ++freeOut[city];
+            ++freeIn[to];
+        });
+    }
+    // the path gets to `city`, or backs up from it
+    auto visit = [&](int city, bool on) {
+        visited[city] = on;
+        forEachIn(city, [&](int from) { freeOut[from] += on ? -1 : 1; });
+    };
+    // the path goes on from `city`, or backs up to it
+    auto leave = [&](int city, bool on) {
+        forEachOut(city, [&](int to) { freeIn[to] += on ? -1 : 1; });
+    };
+
+    // the cities left to try at each position of the tour, one position
+    // after another, with the one to try first on top. Those of position k
+    // start at levelStart[k].
+    std::vector<int> pending;
+    std::vector<size_t> levelStart(n);
+    std::vector<std::pair<uint64_t, int>> options;
+    auto pushOptions = [&](int length, bool nearest) {
+        int from = tour[length - 1];
+        options.clear();
+        int forced = -1;
+        bool deadEnd = false;
+        forEachOut(from, [&](int to) {
+            if(to == start && freeIn[start] == 1) deadEnd = true;
+            if(visited[to]) return;
+            if(freeIn[to] == 1) {
+                deadEnd |= forced != -1;
+                forced = to;
+            }
+            // a city with nowhere left to go can only be the last one
+            if(freeOut[to] == 0 && length + 1 < n) return;
+            uint64_t tie = nearest ? uint64_t(int64_t(adjMatrix(from, to)) - INT32_MIN) : rng() >> 32;
+            options.push_back({uint64_t(freeOut[to]) << 32 | tie, to});
+        });
+        levelStart[length] = pending.size();
+        if(deadEnd) return;
+        if(forced != -1) {
+            if(freeOut[forced] > 0 || length + 1 == n) pending.push_back(forced);
+            return;
+        }
+        std::sort(options.begin(), options.end(), std::greater<>());
+        for(const auto& option : options) pending.push_back(option.second);
+    };
+
+    for(int attempt = 0; attempt < ARC_TOUR_ATTEMPTS; ++attempt) {
+        bool nearest = nearestFirst && attempt == 0;
+        pending.clear();
+        visit(start, true);
+        int length = 1;
+        pushOptions(length, nearest);
+
+        for(long steps = long(ARC_TOUR_STEPS_PER_CITY) * n; steps > 0; --steps) {
+            if(pending.size() == levelStart[length]) {
+                // the whole search is done, there's no tour at all
+                if(length == 1) return false;
+                visit(tour[--length], false);
+                leave(tour[length - 1], false);
+                continue;
+            }
+            int next = pending.back();
+            pending.pop_back();
+            leave(tour[length - 1], true);
+            tour[length++] = next;
+            visit(next, true);
+            if(length == n) {
+                if(!adjMatrix.forbidden(next, start)) return true;
+                visit(tour[--length], false);
+                leave(tour[length - 1], false);
+                continue;
+            }
+            pushOptions(length, nearest);
+        }
+
+        for(int i = length - 1; i > 0; --i) {
+            visit(tour[i], false);
+            leave(tour[i - 1], false);
+        }
+        visit(start, false);
+    }
+    return false;
+}
+
+// Improves a tour of n cities (without the return to the start) with or-opt
+// moves: a segment of 1 to 3 consecutive cities is cut out and put back, in
+// the same direction, between two other consecutive cities. That keeps the
+// direction of all the other edges, so it's valid for asymmetric instances.
+// The best move of each pass is applied until none of them shortens the tour.
+template <typename Weight>
+void orOpt(const DistanceMatrix<Weight>& adjMatrix, int n, std::vector<int>& order) {
+    auto edge = [&](int from, int to) { return heuristicEdge(adjMatrix, from, to); };
+    auto at = [&](int position) { return order[(position % n + n) % n]; };
+
+    while(n > 4) {
+        int64_t bestDelta = 0;
+        int bestStart = 0, bestLength = 0, bestAfter = 0;
+
+        for(int length = 1; length <= 3; ++length) {
+            for(int first = 0; first < n; ++first) {
+                int last = first + length - 1;
+                int before = at(first - 1);
+                int after = at(last + 1);
+                int64_t removed = edge(before, at(first)) + edge(at(last), after) - edge(before, after);
+
+                // put the segment between the cities at `position` and
+                // `position + 1`, going around the rest of the tour
+                for(int offset = 1; offset < n - length; ++offset) {
+                    int position = last + offset;
+                    int64_t added = edge(at(position), at(first)) + edge(at(last), at(position + 1))
+                        - edge(at(position), at(position + 1));
+                    int64_t delta = added - removed;
+                    if(delta < bestDelta) {
+                        bestDelta = delta;
+                        bestStart = first;
+                        bestLength = length;
+                        bestAfter = position % n;
+                    }
+                }
+            }
+        }
+
+        if(bestDelta == 0) break;
+
+        // rotate the tour so that the segment is at its beginning, then move
+        // it behind the city it goes after
+        std::rotate(order.begin(), order.begin() + bestStart, order.end());
+        int after = (bestAfter - bestStart + n) % n;
+        std::rotate(order.begin(), order.begin() + bestLength, order.begin() + after + 1);
+    }
+}
+
+// Returns a good tour starting and ending in city 0: the best of the nearest
+// neighbour tours from every city, improved with or-opt. When all of them
+// take a forbidden edge, it's a tour found along the allowed arcs instead, if
+// there is one.
+template <typename Weight>
+TspSolution heuristicTour(const DistanceMatrix<Weight>& adjMatrix, int n) {
+    std::vector<int> best;
+    int64_t bestCost = INT64_MAX;
+
+    for(int start = 0; start < n; ++start) {
+        std::vector<int> order = nearestNeighbourTour(adjMatrix, n, start);
+        orOpt(adjMatrix, n, order);
+
+        int64_t cost = 0;
+        for(int i = 0; i < n; ++i) {
+            cost += heuristicEdge(adjMatrix, order[i], order[(i + 1) % n]);
+        }
+        if(cost < bestCost) {
+            bestCost = cost;
+            best = order;
+        }
+    }
+
+    if(bestCost >= INT32_MAX) {
+        std::vector<int> order(n);
+        Rng rng;
+        if(tourAlongArcs(adjMatrix, n, 0, rng, true, order.data())) {
+            orOpt(adjMatrix, n, order);
+            bestCost = 0;
+            for(int i = 0; i < n; ++i) bestCost += heuristicEdge(adjMatrix, order[i], order[(i + 1) % n]);
+            best = order;
+        }
+    }
+
+    std::rotate(best.begin(), std::find(best.begin(), best.end(), 0), best.end());
+    best.push_back(0);
+
+    // a tour that needs a forbidden edge is no tour at all
+    if(bestCost >= INT32_MAX) return TspSolution{best, INT32_MAX};
+    return TspSolution{best, int(bestCost)};
+}
@@ -6,13 +6,27 @@
 #include <cassert>
 #include <sstream>
 #include <iostream>
+#include <random>
+#include <memory>
+#include <variant>
+#include <cstring>
+#include <sys/resource.h>
 
-// Contains a solution to the problem
+#include "tsplib.cpp"
+#include "binary_instance.cpp"
+#include "distance_matrix.cpp"
+#include "neighbour_lists.cpp"
+#include "tour_cost.cpp"
+#include "symmetry.cpp"
+#include "coordinates.cpp"
+
+// Contains a solution to the problem. The cost is 64 bit, as the tours of the
+// large instances given by coordinates cost more than fits in an int.
 struct TspSolution {
     std::vector<int> order;
-    int cost;
+    int64_t cost;
 
-    TspSolution(std::vector<int> _order, int _cost) :
+    TspSolution(std::vector<int> _order, int64_t _cost) :
         order(_order), cost(_cost) {}
 };
 
@@ -22,6 +36,55 @@ int index(int y, int x, int n) {
     return y * n + x;
 }
 
+// returns the largest resident set size the process has had so far, in KiB
+long peakRssKb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// generates an asymmetric instance with random distances between 1 and 999,
+// and FORBIDDEN_EDGE on the diagonal
+std::vector<int> genRandomInstance(int numberOfCities, std::mt19937& gen) {
+    std::vector<int> adjMatrix(numberOfCities * numberOfCities);
+    std::uniform_int_distribution<> distribution(1, 999);
+    for (int i = 0; i < numberOfCities; i++) {
+        for (int j = 0; j < numberOfCities; j++) {
+            if (i == j) {
+                adjMatrix[i * numberOfCities + j] = FORBIDDEN_EDGE;
+            }
+            else {
+                adjMatrix[i * numberOfCities + j] = distribution(gen);
+            }
+        }
+    }
+    return adjMatrix;
+}
+
+// Generates an asymmetric instance like genRandomInstance, but with only about
+// `density` of the arcs allowed, the way routing graphs have them, and the
+// rest FORBIDDEN_EDGE. The arcs of a random tour are always allowed, so that
+// there is one.
+std::vector<int> genSparseInstance(int numberOfCities, double density, std::mt19937& gen) {
+    std::vector<int> adjMatrix = genRandomInstance(numberOfCities, gen);
+    std::bernoulli_distribution allowed(density);
+    for (int i = 0; i < numberOfCities; i++) {
+        for (int j = 0; j < numberOfCities; j++) {
+            if (i != j && !allowed(gen)) adjMatrix[i * numberOfCities + j] = FORBIDDEN_EDGE;
+        }
+    }
+
+    std::vector<int> tour(numberOfCities);
+    std::iota(tour.begin(), tour.end(), 0);
+    std::shuffle(tour.begin(), tour.end(), gen);
+    std::uniform_int_distribution<> distribution(1, 999);
+    for (int i = 0; i < numberOfCities && numberOfCities > 1; i++) {
+        int& weight = adjMatrix[tour[i] * numberOfCities + tour[(i + 1) % numberOfCities]];
+        if (weight == FORBIDDEN_EDGE) weight = distribution(gen);
+    }
+    return adjMatrix;
+}
+
 template <typename T>
 void printVec(const std::vector<T>& vec) {
     for(auto& v: vec) {
@@ -30,105 +93,149 @@ void printVec(const std::vector<T>& vec) {
     std::cout << "\n";
 }
 
-class Tsp {
-    std::vector<int> adjMatrix;
-    int n;
+// An instance of the problem, with weights of type `Weight` (see
+// DistanceMatrix). The solvers are templates over the type of the instance,
+// and are instantiated for each one that loadTsp can pick.
+template <typename Weight>
+class BasicTsp {
+    DistanceMatrix<Weight> adjMatrix;
+    // found when the instance is made, so the solvers can pick their
+    // symmetric specializations (see symmetry.cpp)
+    bool symmetric;
+    CandidateLists candidateLists;
 
 public:
-    Tsp(const std::vector<int>& _adjMatrix, int _n) : adjMatrix(std::move(_adjMatrix)), n(_n) {}
+    using Distances = DistanceMatrix<Weight>;
+
+    BasicTsp(DistanceMatrix<Weight> _adjMatrix) :
+        adjMatrix(std::move(_adjMatrix)), symmetric(isSymmetricMatrix(adjMatrix, adjMatrix.size())) {}
+
+    // for a matrix already known to be symmetric or not
+    BasicTsp(DistanceMatrix<Weight> _adjMatrix, bool _symmetric) :
+        adjMatrix(std::move(_adjMatrix)), symmetric(_symmetric) {}
 
-    static Tsp loadFromFile(const std::string& filename) {
-        if(filename.substr(filename.find_last_of(".") + 1) == "atsp") {
-            return loadFromAtsp(filename);
+    BasicTsp(const std::vector<int>& _adjMatrix, int n) : BasicTsp(DistanceMatrix<Weight>(_adjMatrix, n)) {}
+
+    // Loads a binary instance (.tspbin), a TSPLIB one (.atsp or .tsp) or a
+    // matrix in the format of graphs/ (any other extension). Throws
+    // std::runtime_error if the file can't be read or parsed, or if its
+    // weights don't fit in `Weight`.
+    static BasicTsp loadFromFile(const std::string& filename) {
+        std::string extension = filename.substr(filename.find_last_of(".") + 1);
+        if(extension == "tspbin") {
+            return loadFromBinary(filename);
+        } else if(extension == "atsp" || extension == "tsp") {
+            return loadFromTsplib(filename);
         } else {
             return loadFromTxt(filename);
         }
     }
 
-    static Tsp loadFromAtsp(const std::string& filename) {
-        std::ifstream file(filename);
-        std::string line;
-        std::stringstream ss;
-        std::string s;
-        int n = 0;
+    static BasicTsp loadFromTsplib(const std::string& filename) {
+        int n;
+        std::vector<int> adjMatrix = loadMatrix(filename, n, parseTsplib);
+        return BasicTsp{adjMatrix, n};
+    }
 
-        while(line != "EDGE_WEIGHT_SECTION") {
-            std::getline(file, line);
+    static BasicTsp loadFromTxt(const std::string& filename) {
+        int n;
+        std::vector<int> adjMatrix = loadMatrix(filename, n, parseMatrixTxt);
+        return BasicTsp{adjMatrix, n};
+    }
 
-            ss.str("");
-            ss << line;
-            ss >> s;
-            if(s == "DIMENSION:") {
-                ss >> n;
+    // Maps a binary instance file (see binary_instance.cpp) and uses the matrix
+    // in place, without copying it. Only the checksum is computed over it. A
+    // file with weights of another size than `Weight` is copied instead.
+    static BasicTsp loadFromBinary(const std::string& filename) {
+        auto file = std::make_shared<const MappedFile>(MappedFile::open(filename, MADV_WILLNEED));
+        try {
+            const BinaryInstanceHeader& header = readBinaryHeader(*file);
+            if (header.weightBytes != sizeof(Weight)) {
+                return BasicTsp{binaryMatrix(*file), int(header.n)};
             }
+            const Weight* weights = reinterpret_cast<const Weight*>(file->bytes() + sizeof(BinaryInstanceHeader));
+            return BasicTsp{DistanceMatrix<Weight>{file, weights, header.rowBytes / sizeof(Weight), int(header.n)},
+                (header.flags & BINARY_SYMMETRIC) != 0};
         }
-
-        std::vector<int> adjMatrix;
-        while(true) {
-            file >> s;
-            if(s == "EOF")  break;
-
-            adjMatrix.push_back(std::stoi(s));
+        catch (const std::runtime_error& e) {
+            throw std::runtime_error(filename + ": " + e.what());
         }
-
-        return Tsp{adjMatrix, n};
     }
 
-    static Tsp loadFromTxt(const std::string& filename) {
-        int n;
-        std::vector<int> adjMatrix;
+    // writes the instance to `filename` in the binary format
+    void saveToBinary(const std::string& filename) const {
+        const int n = size();
+        uint64_t rowBytes = binaryRowBytes(n, sizeof(Weight));
+        MappedFile file = MappedFile::create(filename, sizeof(BinaryInstanceHeader) + n * rowBytes);
+        uint8_t* matrix = file.bytes() + sizeof(BinaryInstanceHeader);
+        for (int y = 0; y < n; ++y) {
+            std::memcpy(matrix + y * rowBytes, adjMatrix.row(y), n * sizeof(Weight));
+        }
 
-        std::ifstream file;
-        try {
-            file.open(filename);
-            file.exceptions(std::ifstream::failbit);
+        BinaryInstanceHeader header = {};
+        std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        header.version = BINARY_VERSION;
+        header.n = n;
+        header.weightBytes = sizeof(Weight);
+        header.flags = isSymmetric() ? BINARY_SYMMETRIC : 0;
+        header.rowBytes = rowBytes;
+        header.checksum = binaryChecksum(matrix, n * rowBytes);
+        std::memcpy(file.bytes(), &header, sizeof(header));
+    }
 
-            file >> n;
+    size_t size() const { return adjMatrix.size(); }
 
-            for (int i = 0; i < n; ++i) {
-                for (int j = 0; j < n; ++j) {
-                    int distance;
-                    file >> distance;
-                    adjMatrix.push_back(distance);
-                }
-            }
+    Weight get(size_t x, size_t y) const {
+        return adjMatrix(y, x);
+    }
 
-        } catch(const std::ios_base::failure& e) {
-            std::cout << e.what() << std::endl;
-            std::cout << strerror(errno) << std::endl;
-            file.clear();
-        }
+    const DistanceMatrix<Weight>& getAdjMatrix() const {
+        return adjMatrix;
+    }
 
-        return Tsp{adjMatrix, n};
+    // the nearest cities of every city, for the heuristics to draw moves from
+    const NeighbourLists& candidates() const {
+        return candidateLists.get(adjMatrix, symmetric);
     }
 
-    size_t size() const { return n; }
+    double candidatesSeconds() const {
+        return candidateLists.buildSeconds();
+    }
 
-    int& get(size_t x, size_t y) {
-        return adjMatrix[y * n + x];
+    // the arcs tours may use, see AllowedArcs
+    const AllowedArcs& arcs() const {
+        return adjMatrix.allowedArcs();
     }
 
-    const int& get(size_t x, size_t y) const {
-        return adjMatrix[y * n + x];
+    // whether some of the edges are forbidden, so that not every order of
+    // the cities is a tour
+    bool hasForbiddenEdges() const {
+        return arcs().count < int64_t(size()) * (int64_t(size()) - 1);
     }
 
-    std::vector<int> getAdjMatrix() {
-        return adjMatrix;
+    // whether the weight of every edge is the same in both directions
+    bool isSymmetric() const {
+        return symmetric;
     }
 
-    int cost(const std::vector<int>& order) const {
-        int sum = 0;
-        size_t prevCity = order[0];
-        for (size_t i = 1; i < order.size(); ++i) {
-            sum += get(prevCity, order[i]);
-            prevCity = order[i];
-        }
+    // cost of the path through the cities of `order`, which ends where it
+    // starts if it's a whole tour
+    int64_t cost(const std::vector<int>& order) const {
+        int64_t sum;
+        tourCosts(order.data(), 1, order.size(), false, &sum);
         return sum;
     }
 
+    // writes the costs of `count` tours of `length` cities, stored one after
+    // another, to `costs` (see tour_cost.cpp)
+    void tourCosts(const int* tours, size_t count, int length, bool closed, int64_t* costs,
+            ThreadPool* pool = nullptr) const {
+        ::tourCosts(adjMatrix, tours, count, length, closed, costs, pool);
+    }
+
     void print() const {
-        for(int y = 0; y < n; ++y) {
-            for(int x = 0; x < n; ++x) {
+        for(size_t y = 0; y < size(); ++y) {
+            for(size_t x = 0; x < size(); ++x) {
                 std::cout << get(x, y) << " ";
             }
             std::cout << "\n";
@@ -136,3 +243,55 @@ public:
         std::cout << std::endl;
     }
 };
+
+using Tsp = BasicTsp<int32_t>;
+
+// instances given by the coordinates of more cities than this are kept as
+// coordinates, as their matrix would take 4 * n^2 bytes (400 MB here)
+const int COORDINATE_INSTANCE_MIN = 10000;
+
+// whether the TSPLIB file has the planar coordinates of more than
+// COORDINATE_INSTANCE_MIN cities, from its header alone
+bool isLargeCoordinateInstance(const std::string& filename) {
+    MappedFile file = MappedFile::open(filename, MADV_NORMAL);
+    const char* begin = reinterpret_cast<const char*>(file.bytes());
+    try {
+        TextScanner text(begin, begin + file.size());
+        TsplibHeader header = parseTsplibHeader(text);
+        const std::string& type = header.weightType;
+        return header.n > COORDINATE_INSTANCE_MIN && header.section == "NODE_COORD_SECTION"
+            && (type == "EUC_2D" || type == "CEIL_2D" || type == "ATT");
+    }
+    catch (const std::runtime_error&) {
+        // the parser of the whole file reports what's wrong with it
+        return false;
+    }
+}
+
+// an instance with the weight type that loadTsp picked for it, or with only
+// the coordinates of its cities
+using AnyTsp = std::variant<BasicTsp<int16_t>, BasicTsp<int32_t>, CoordinateTsp>;
+
+// Loads an instance like BasicTsp::loadFromFile, with the narrowest weight type
+// that fits it. A binary instance keeps the type it was written with, and a
+// large one given by planar coordinates becomes a CoordinateTsp.
+AnyTsp loadTsp(const std::string& filename) {
+    std::string extension = filename.substr(filename.find_last_of(".") + 1);
+    if(extension == "tsp" && isLargeCoordinateInstance(filename)) {
+        return CoordinateTsp::loadFromTsplib(filename);
+    }
+    if(extension == "tspbin") {
+        MappedFile file = MappedFile::open(filename);
+        int weightBytes = file.size() >= sizeof(BinaryInstanceHeader)
+            ? reinterpret_cast<const BinaryInstanceHeader*>(file.bytes())->weightBytes : 0;
+        if (weightBytes == sizeof(int16_t)) return BasicTsp<int16_t>::loadFromBinary(filename);
+        return BasicTsp<int32_t>::loadFromBinary(filename);
+    }
+
+    int n;
+    std::vector<int> adjMatrix = extension == "atsp" || extension == "tsp"
+        ? loadMatrix(filename, n, parseTsplib)
+        : loadMatrix(filename, n, parseMatrixTxt);
+    if (narrowestWeightBytes(adjMatrix, n) == sizeof(int16_t)) return BasicTsp<int16_t>{adjMatrix, n};
+    return BasicTsp<int32_t>{adjMatrix, n};
+}
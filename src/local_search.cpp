@@ -0,0 +1,201 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+
+#include "distance_matrix.cpp"
+#include "neighbour_lists.cpp"
+#include "symmetry.cpp"
+
+// Improves tours with segment insertion: a segment of consecutive cities is
+// cut out and put back, in the same direction, between two other consecutive
+// cities. For segments of up to 3 cities that's or-opt, for longer ones it's
+// the 3-opt move that keeps the direction of every edge, so it's valid for
+// asymmetric instances.
+//
+// The tour is kept as a doubly linked list, so a move is O(1) to make. Only
+// moves that add an edge from the neighbour lists are tried, starting from the
+// cities on a queue. A city is left off the queue (its don't-look bit is set)
+// once no move starting from it improves the tour, and put back when one of
+// its edges changes, which makes a pass close to linear in n. A move that
+// adds a forbidden edge is never an improvement, so a tour that has none keeps
+// having none.
+//
+// With the Symmetric tag the segment may also be put back reversed, which
+// doesn't change the cost of its own edges there. That move takes O(segment)
+// to make, as the links inside of the segment turn around.
+template <typename Distances, typename Symmetry = Asymmetric>
+class LocalSearch {
+    const Distances& adjMatrix;
+    int n;
+    const NeighbourLists& neighbours;
+
+    std::vector<int> successor, predecessor;
+    std::vector<int> queue;
+    std::vector<bool> queued;
+    int queueHead = 0, queueSize = 0;
+
+    static constexpr int MAX_SEGMENT = 25;
+
+    // forbidden edges count as FORBIDDEN_EDGE_PENALTY, so the tour never
+    // gets one
+    int64_t d(int from, int to) const {
+        return penalizedWeight(adjMatrix(from, to));
+    }
+
+    void push(int city) {
+        if (queued[city]) return;
+        queued[city] = true;
+        queue[(queueHead + queueSize++) % n] = city;
+    }
+
+    int pop() {
+        int city = queue[queueHead];
+        queueHead = (queueHead + 1) % n;
+        --queueSize;
+        queued[city] = false;
+        return city;
+    }
+
+    // Moves the segment first .. last between c and its successor. The caller
+    // makes sure that c is outside of the segment and isn't right before it.
+    void move(int first, int last, int c) {
+        int a = predecessor[first], b = successor[last], next = successor[c];
+        successor[a] = b;
+        predecessor[b] = a;
+        successor[c] = first;
+        predecessor[first] = c;
+        successor[last] = next;
+        predecessor[next] = last;
+        for (int city : {a, b, c, next, first, last}) push(city);
+    }
+
+    // moves the segment first .. last between c and its successor reversed,
+    // so that c goes to last, under the same conditions as `move`
+    void moveReversed(int first, int last, int c) {
+        int a = predecessor[first], b = successor[last];
+        successor[a] = b;
+        predecessor[b] = a;
+        int next = successor[c];
+        for (int city = first;; city = predecessor[city]) {
+            std::swap(successor[city], predecessor[city]);
+            if (city == last) break;
+        }
+        successor[c] = last;
+        predecessor[last] = c;
+        successor[first] = next;
+        predecessor[next] = first;
+        for (int city : {a, b, c, next, first, last}) push(city);
+    }
+
+    // Looks for an improving move of a segment starting or ending in u, and
+    // makes the first one found. Returns its gain, 0 if there's none.
+    int64_t improveCity(int u) {
+        const int maxSegment = std::min(MAX_SEGMENT, n - 3);
+
+        // u starts the segment: c -> u is a new edge, and the segment goes
+        // forward from u to last
+        int a = predecessor[u];
+        for (int i = 0; i < neighbours.k; i++) {
+            int c = neighbours.in[u * neighbours.k + i];
+            int64_t partial = d(a, u) - d(c, u);
+            if (partial <= 0) break;
+            if (c == a) continue;
+
+            int next = successor[c];
+            int last = u;
+            for (int length = 1; length <= maxSegment && last != c; length++) {
+                int b = successor[last];
+                if (b == c) break;
+                int64_t gain = partial + d(last, b) + d(c, next) - d(a, b) - d(last, next);
+                if (gain > 0) {
+                    move(u, last, c);
+                    return gain;
+                }
+                if constexpr (Symmetry::symmetric) {
+                    // or reversed before c, so that u goes to c
+                    int before = predecessor[c];
+                    gain = partial + d(last, b) + d(before, c) - d(a, b) - d(before, last);
+                    if (gain > 0) {
+                        moveReversed(u, last, before);
+                        return gain;
+                    }
+                }
+                last = b;
+            }
+        }
+
+        // u ends the segment: u -> next is a new edge, and the segment goes
+        // back from u to first
+        int b = successor[u];
+        for (int i = 0; i < neighbours.k; i++) {
+            int next = neighbours.out[u * neighbours.k + i];
+            int64_t partial = d(u, b) - d(u, next);
+            if (partial <= 0) break;
+            if (next == b) continue;
+
+            int c = predecessor[next];
+            int first = u;
+            for (int length = 1; length <= maxSegment && first != next; length++) {
+                int a = predecessor[first];
+                if (a == next) break;
+                if (c != a) {
+                    int64_t gain = partial + d(a, first) + d(c, next) - d(a, b) - d(c, first);
+                    if (gain > 0) {
+                        move(first, u, c);
+                        return gain;
+                    }
+                }
+                if constexpr (Symmetry::symmetric) {
+                    // or reversed after next, so that next goes to u
+                    int after = successor[next];
+                    int64_t gain = partial + d(a, first) + d(next, after) - d(a, b) - d(first, after);
+                    if (gain > 0) {
+                        moveReversed(first, u, next);
+                        return gain;
+                    }
+                }
+                first = a;
+            }
+        }
+        return 0;
+    }
+
+public:
+    LocalSearch(const Distances& _adjMatrix, int _n, const NeighbourLists& _neighbours) :
+        adjMatrix(_adjMatrix), n(_n), neighbours(_neighbours),
+        successor(_n), predecessor(_n), queue(_n), queued(_n, false) {}
+
+    // improves the tour of n cities in place until no move from the
+    // neighbour lists shortens it, and returns by how much it got shorter
+    int64_t improve(int* tour) {
+        if (n < 5) return 0;
+
+        for (int i = 0; i < n; i++) {
+            int next = tour[(i + 1) % n];
+            successor[tour[i]] = next;
+            predecessor[next] = tour[i];
+        }
+        queueHead = queueSize = 0;
+        for (int i = 0; i < n; i++) push(tour[i]);
+
+        int64_t gain = 0;
+        while (queueSize > 0) {
+            int u = pop();
+            int64_t improvement = improveCity(u);
+            if (improvement > 0) {
+                gain += improvement;
+                push(u);
+            }
+        }
+
+        int city = tour[0];
+        for (int i = 0; i < n; i++) {
+            tour[i] = city;
+            city = successor[city];
+        }
+        return gain;
+    }
+};
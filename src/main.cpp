@@ -8,6 +8,8 @@
 #include <random>
 #include <sstream>
 #include <cstring>
+#include <optional>
+#include <variant>
 
 #include "lib.h"
 #include "brute_force.cpp"
@@ -15,39 +17,102 @@
 #include "branch_and_bound.cpp"
 #include "satspsolver.cpp"
 #include "gatspsolver.cpp"
+#include "benchmark.cpp"
 
 const int INSTANCE_SIZE_MIN = 8;
 const int INSTANCE_SIZE_MAX = 20;
 const int REPETITIONS = 10;
+// largest instance the brute force method is timed on, chosen arbitrarily
+const int BRUTE_FORCE_SIZE_MAX = 15;
+// largest instances loaded from a file that still get solved exactly, with
+// the full table and with only two layers of it kept in memory
+const int DP_SIZE_MAX = 25;
+const int DP_LAYERED_SIZE_MAX = 30;
+// memory the branch and bound queue may take before it continues depth first
+const size_t BNB_MEMORY_BUDGET = size_t(1) << 30;
+// the branch and bound solution keeps the visited cities in 64 bits
+const int BNB_SIZE_MAX = 64;
 
-std::vector<int> genRandomInstance(int numberOfCities, std::mt19937& gen) {
-    std::vector<int> adjMatrix(numberOfCities * numberOfCities);
-    std::uniform_int_distribution<> distribution(1, 999);
-    for (int i = 0; i < numberOfCities; i++) {
-        for (int j = 0; j < numberOfCities; j++) {
-            if (i == j) {
-                adjMatrix[i * numberOfCities + j] = -1;
-            }
-            else {
-                adjMatrix[i * numberOfCities + j] = distribution(gen);
-            }
-        }
+// seed of the stochastic solvers, random if not given
+std::optional<uint64_t> solverSeed;
+// bound of the branch and bound solution, instances loaded from a file are
+// only solved with it if it's given
+std::optional<BnbBound> bnbBound;
+
+// the branch and bound bound of the given name, if there's one
+std::optional<BnbBound> bnbBoundNamed(const std::string& name) {
+    for (BnbBound bound : {BnbBound::Reduction, BnbBound::Assignment}) {
+        if (name == bnbBoundName(bound)) return bound;
     }
-    return adjMatrix;
+    return std::nullopt;
 }
 
-void testOnFile(const std::string& filename) {
+// `Symmetry` is the tag of the instance, the solvers are specialized on it
+template <typename Symmetry, typename Instance>
+void solveInstance(const Instance& tsp, int threads, const std::string& spillPath) {
     auto time1 = std::chrono::system_clock::now();
     auto time2 = std::chrono::system_clock::now();
 
-    Tsp tsp = Tsp::loadFromFile(filename);
-    GaTspSolver gaSolver(tsp);
+    int n = tsp.size();
+    constexpr bool coordinates = std::is_same_v<Instance, CoordinateTsp>;
+    if constexpr (coordinates) {
+        std::cout << "weights: computed from coordinates" << std::endl;
+    }
+    else {
+        std::cout << "weights: " << sizeof(tsp.get(0, 0)) * 8 << " bit" << std::endl;
+    }
+    std::cout << "symmetric: " << (Symmetry::symmetric ? "yes" : "no") << std::endl;
+
+    // instances given by coordinates are too large for the exact solvers
+    if constexpr (!coordinates) {
+        if (n <= DP_LAYERED_SIZE_MAX) {
+            time1 = std::chrono::system_clock::now();
+            TspSolution dp = n <= DP_SIZE_MAX
+                ? tspDp<Symmetry>(tsp.getAdjMatrix(), n, threads)
+                : tspDpLayered<Symmetry>(tsp.getAdjMatrix(), n, threads, spillPath);
+            time2 = std::chrono::system_clock::now();
+
+            std::cout << "DYNAMIC PROGRAMMING" << std::endl;
+            std::cout << "took: " << std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1).count() << "ms" << std::endl;
+            std::cout << "peak RSS: " << peakRssKb() / 1024 << "MiB" << std::endl;
+            std::cout << "Found minimum cost: " << dp.cost << std::endl;
+            std::cout << "order: ";
+            printVec(dp.order);
+        }
+
+        if (bnbBound && n <= BNB_SIZE_MAX) {
+            BnbOptions options = heuristicBnbOptions(tsp.getAdjMatrix(), n, BNB_MEMORY_BUDGET);
+            options.bound = *bnbBound;
+            time1 = std::chrono::system_clock::now();
+            TspSolution bnb = tspBnb<Symmetry>(tsp.getAdjMatrix(), n, options);
+            time2 = std::chrono::system_clock::now();
+
+            std::cout << "BRANCH AND BOUND" << std::endl;
+            std::cout << "bound: " << bnbBoundName(*bnbBound) << std::endl;
+            std::cout << "took: " << std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1).count() << "ms" << std::endl;
+            std::cout << "Found minimum cost: " << bnb.cost << std::endl;
+            std::cout << "order: ";
+            printVec(bnb.order);
+        }
+    }
+
+    tsp.candidates();
+    std::cout << "candidate lists: " << tsp.candidates().k << " cities each, built in "
+        << tsp.candidatesSeconds() * 1000 << "ms" << std::endl;
+
+    // with more threads, the genetic algorithm evolves one island on each
+    GaOptions options;
+    options.islands.threads = threads;
+    options.islands.islands = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    GaTspSolver<Instance, Symmetry> gaSolver(tsp, options);
+    if (solverSeed) gaSolver.setSeed(*solverSeed);
 
     time1 = std::chrono::system_clock::now();
     TspSolution tsp3 = gaSolver.solve(0, 120);
     time2 = std::chrono::system_clock::now();
 
     std::cout << "GENETIC ALGORITHM" << std::endl;
+    std::cout << "seed: " << gaSolver.getSeed() << std::endl;
     std::cout << "took: " << std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1).count() << "ms" << std::endl;
     std::cout << "Found minimum cost: " << tsp3.cost << std::endl;
     std::cout << "order: ";
@@ -57,7 +122,47 @@ void testOnFile(const std::string& filename) {
     std::cout << std::endl;
 }
 
-void testOnRandomData(const std::string& filename, int min, int max, int reps) {
+void testOnFile(const std::string& filename, int threads, const std::string& spillPath) {
+    std::optional<AnyTsp> tsp;
+    try {
+        tsp = loadTsp(filename);
+    }
+    catch (const std::runtime_error& e) {
+        std::cout << e.what() << std::endl;
+        return;
+    }
+    std::visit([&](const auto& instance) {
+        withSymmetry(instance.isSymmetric(), [&](auto symmetry) {
+            solveInstance<decltype(symmetry)>(instance, threads, spillPath);
+        });
+    }, *tsp);
+}
+
+// converts the instance in file `input` to the binary format, in file `output`
+void convertInstance(const std::string& input, const std::string& output) {
+    try {
+        auto start = std::chrono::steady_clock::now();
+        std::visit([&](const auto& tsp) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(tsp)>, CoordinateTsp>) {
+                std::cout << "instances of more than " << COORDINATE_INSTANCE_MIN
+                    << " cities given by coordinates aren't converted, their matrix is too large" << std::endl;
+            }
+            else {
+                tsp.saveToBinary(output);
+                auto end = std::chrono::steady_clock::now();
+
+                std::cout << "converted " << tsp.size() << " cities" << (tsp.isSymmetric() ? " (symmetric)" : "")
+                    << " with " << sizeof(tsp.get(0, 0)) * 8 << " bit weights in "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms" << std::endl;
+            }
+        }, loadTsp(input));
+    }
+    catch (const std::runtime_error& e) {
+        std::cout << e.what() << std::endl;
+    }
+}
+
+void testOnRandomData(const std::string& filename, int min, int max, int reps, int threads) {
     std::random_device rd;
     std::mt19937 gen(0);
 
@@ -69,20 +174,19 @@ void testOnRandomData(const std::string& filename, int min, int max, int reps) {
         results << i << ",";
 
         std::cout << "INSTANCE SIZE: " << i << std::endl;
-        std::vector<std::vector<int>> instances;
+        // the distances are below 1000, so they fit in 16 bits
+        std::vector<DistanceMatrix<int16_t>> instances;
         for (int rep = 0; rep < reps; ++rep) {
-            std::vector<int> adjMatrix = genRandomInstance(i, gen);
-            instances.emplace_back(adjMatrix);
+            instances.emplace_back(genRandomInstance(i, gen), i);
         }
 
         auto start = std::chrono::system_clock::now();
         auto end = std::chrono::system_clock::now();
 
-        // chosen arbitrarily
-        if (i <= 12) {
+        if (i <= BRUTE_FORCE_SIZE_MAX) {
             start = std::chrono::system_clock::now();
             for (auto& instance : instances) {
-                tspBruteforce(instance, i);
+                tspBruteforceDfs(instance, i, threads);
             }
             end = std::chrono::system_clock::now();
             int bfTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / reps;
@@ -94,9 +198,18 @@ void testOnRandomData(const std::string& filename, int min, int max, int reps) {
             results << "-1,";
         }
 
+        // the parallel solution only bounds the nodes by the reductions
+        const BnbBound bound = bnbBound.value_or(BnbBound::Reduction);
         start = std::chrono::system_clock::now();
         for (auto& instance : instances) {
-            tspBnb(instance, i);
+            if (threads == 1 || bound != BnbBound::Reduction) {
+                BnbOptions options = heuristicBnbOptions(instance, i, BNB_MEMORY_BUDGET);
+                options.bound = bound;
+                tspBnb(instance, i, options);
+            }
+            else {
+                tspBnbParallel(instance, i, threads);
+            }
         }
         end = std::chrono::system_clock::now();
         int bnbTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / reps;
@@ -105,7 +218,7 @@ void testOnRandomData(const std::string& filename, int min, int max, int reps) {
 
         start = std::chrono::system_clock::now();
         for (auto& instance : instances) {
-            tspDp(instance, i);
+            tspDp(instance, i, threads);
         }
         end = std::chrono::system_clock::now();
         int dpTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / reps;
@@ -124,9 +237,36 @@ int main(int argc, char** argv) {
     std::mt19937 gen(0);
 
     if (argc < 2) {
-        std::cout << "random OUTPUT MIN MAX REPETITIONS - generates REPETITIONS instances of sizes from MIN to MAX, "
+        std::cout << "random OUTPUT MIN MAX REPETITIONS [THREADS] - generates REPETITIONS instances of sizes from MIN to MAX, "
             "solves using all the methods, and saves results to file OUTPUT" << std::endl;
-        std::cout << "file PATH - loads instance from file of name PATH and prints the solution" << std::endl;
+        std::cout << "file PATH [THREADS] [SPILL] - loads instance from file of name PATH (a TSPLIB .atsp or .tsp, a binary .tspbin, or a matrix) "
+            "and prints the solution. "
+            "TSPLIB instances of over " << COORDINATE_INSTANCE_MIN << " cities given by EUC_2D, CEIL_2D or ATT coordinates "
+            "keep only the coordinates, and are solved with the genetic algorithm alone. "
+            "Instances over " << DP_SIZE_MAX << " cities keep the dynamic programming tour data in a new file SPILL, if given, "
+            "which is removed as soon as it's mapped" << std::endl;
+        std::cout << "THREADS is the number of threads used by the parallel solvers, 0 uses all of them (default: 1)" << std::endl;
+        std::cout << "bench NAME [ARGS...] - runs the microbenchmark NAME: dp, or bnb FILE... to compare "
+            "the branch and bound bounds on the instances in FILEs, or ga FILE... to measure the generations "
+            "per second and the heap allocations of the genetic algorithm, or crossover FILE... to compare "
+            "its crossover operators, or memetic FILE... to measure the overhead of its local search, or selection FILE... "
+            "to compare the parent selection methods on growing populations, or load [N...] to measure how fast "
+            "instances of N cities are loaded (default: 5000 and 10000), or weights FILE... to compare the solvers "
+            "on the instances loaded with 16 and 32 bit weights, or tourcost [N...] to measure how many tours per second "
+            "each kernel of the batched tour costs scores (default: 17, 47, 170 and 403), or candidates FILE... to measure what drawing moves from the candidate lists gives "
+            "the heuristics, or coordinates [N...] to run the heuristic solvers "
+            "on random instances of N cities given by coordinates (default: 20000, 50000 and 100000), or symmetry [N...] "
+            "to compare the solvers specialized for symmetric instances to the generic ones, with the exact solvers "
+            "on random symmetric instances of N cities (default: 12, 16, 20 and 22), or sparse [N...] to compare "
+            "going over the lists of allowed arcs to going over whole rows, with the exact solvers on random instances "
+            "of N cities with 10 to 20% of the arcs allowed (default: 16, 20 and 22)" << std::endl;
+        std::cout << "convert INPUT OUTPUT - converts the instance in file INPUT to the binary format, which "
+            "loads without parsing, and saves it to file OUTPUT (use the .tspbin extension)" << std::endl;
+        std::cout << "seed SEED - makes the stochastic solvers use SEED, so that their runs can be repeated "
+            "(--seed SEED before the command when given as arguments)" << std::endl;
+        std::cout << "bound NAME - makes the branch and bound solution bound the nodes by NAME: reduction (default) "
+            "or assignment, and has file solve the instance with it as well "
+            "(--bound NAME before the command when given as arguments)" << std::endl;
         std::cout << "q, exit - exits the program" << std::endl;
 
         bool exit = false;
@@ -145,13 +285,40 @@ int main(int argc, char** argv) {
                 int min = 12;
                 int max = 20;
                 int reps = 100;
-                words >> filename >> min >> max >> reps;
-                testOnRandomData(filename, min, max, reps);
+                int threads = 1;
+                words >> filename >> min >> max >> reps >> threads;
+                testOnRandomData(filename, min, max, reps, threads);
             }
             else if (cmd == "file") {
                 std::string filename;
-                words >> filename;
-                testOnFile(filename);
+                int threads = 1;
+                std::string spillPath;
+                words >> filename >> threads >> spillPath;
+                testOnFile(filename, threads, spillPath);
+            }
+            else if (cmd == "bench") {
+                std::string name;
+                words >> name;
+                std::vector<std::string> args;
+                for (std::string arg; words >> arg;) {
+                    args.push_back(arg);
+                }
+                runBenchmark(name, args);
+            }
+            else if (cmd == "convert") {
+                std::string input, output;
+                words >> input >> output;
+                convertInstance(input, output);
+            }
+            else if (cmd == "seed") {
+                uint64_t seed;
+                if (words >> seed) solverSeed = seed;
+            }
+            else if (cmd == "bound") {
+                std::string name;
+                words >> name;
+                bnbBound = bnbBoundNamed(name);
+                if (!bnbBound) std::cout << "unknown bound: " << name << std::endl;
             }
             else if (cmd == "q" || cmd == "exit")
                 exit = true;
@@ -159,16 +326,40 @@ int main(int argc, char** argv) {
     }
 
     else {
+        while (argc > 3) {
+            if (std::string(argv[1]) == "--seed") {
+                solverSeed = std::stoull(argv[2]);
+            }
+            else if (std::string(argv[1]) == "--bound") {
+                bnbBound = bnbBoundNamed(argv[2]);
+                if (!bnbBound) std::cout << "unknown bound: " << argv[2] << std::endl;
+            }
+            else {
+                break;
+            }
+            argv += 2;
+            argc -= 2;
+        }
+
         if (std::string(argv[1]) == "random") {
             std::string filename(argv[2]);
-            int min = argc >= 3 ? std::atoi(argv[2]) : 12;
-            int max = argc >= 4 ? std::atoi(argv[3]) : 20;
-            int reps = argc >= 5 ? std::atoi(argv[4]) : 100;
-            testOnRandomData(filename, min, max, reps);
+            int min = argc > 3 ? std::atoi(argv[3]) : 12;
+            int max = argc > 4 ? std::atoi(argv[4]) : 20;
+            int reps = argc > 5 ? std::atoi(argv[5]) : 100;
+            int threads = argc > 6 ? std::atoi(argv[6]) : 1;
+            testOnRandomData(filename, min, max, reps, threads);
         }
         else if (std::string(argv[1]) == "file") {
             std::string filename = argv[2];
-            testOnFile(filename);
+            int threads = argc > 3 ? std::atoi(argv[3]) : 1;
+            std::string spillPath = argc > 4 ? argv[4] : "";
+            testOnFile(filename, threads, spillPath);
+        }
+        else if (std::string(argv[1]) == "convert" && argc > 3) {
+            convertInstance(argv[2], argv[3]);
+        }
+        else if (std::string(argv[1]) == "bench" && argc > 2) {
+            runBenchmark(argv[2], std::vector<std::string>(argv + 3, argv + argc));
         }
 
         return 0;
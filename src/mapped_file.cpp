@@ -0,0 +1,115 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// A file mapped into memory. The mapping is released, and the file closed,
+// when the object is destroyed.
+class MappedFile {
+    void* data = nullptr;
+    size_t length = 0;
+
+    MappedFile(void* _data, size_t _length) : data(_data), length(_length) {}
+
+    static std::runtime_error error(const std::string& what, const std::string& path) {
+        return std::runtime_error(what + " " + path + ": " + strerror(errno));
+    }
+
+    // opens the file at `path` with `flags`, resizes it to `size` bytes and
+    // maps it for reading and writing
+    static MappedFile createWith(const std::string& path, size_t size, int flags) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | flags, 0644);
+        if(fd == -1) throw error("could not create", path);
+
+        if(ftruncate(fd, size) == -1) {
+            ::close(fd);
+            throw error("could not resize", path);
+        }
+
+        void* data = size == 0 ? nullptr : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(data == MAP_FAILED) throw error("could not map", path);
+
+        return MappedFile{data, size};
+    }
+
+public:
+    MappedFile() = default;
+
+    MappedFile(MappedFile&& other) noexcept :
+        data(std::exchange(other.data, nullptr)),
+        length(std::exchange(other.length, 0)) {}
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        std::swap(data, other.data);
+        std::swap(length, other.length);
+        return *this;
+    }
+
+    ~MappedFile() {
+        if(data != nullptr) munmap(data, length);
+    }
+
+    // creates (or truncates) the file at `path`, resizes it to `size` bytes
+    // and maps it for reading and writing. Changes are written back to the
+    // file, so the kernel may evict the pages from memory at any time.
+    static MappedFile create(const std::string& path, size_t size) {
+        return createWith(path, size, O_TRUNC);
+    }
+
+    // Maps a new file of `size` bytes at `path` as scratch space, which the
+    // kernel can move pages of memory out to. The file is removed as soon as
+    // it's mapped, so it only takes disk space until the mapping is released,
+    // and is gone even if the program is killed. Throws std::runtime_error if
+    // the file already exists, rather than overwrite it.
+    static MappedFile createScratch(const std::string& path, size_t size) {
+        MappedFile file = createWith(path, size, O_EXCL);
+        ::unlink(path.c_str());
+        return file;
+    }
+
+    // maps the file at `path` for reading, with private copy-on-write pages.
+    // `advice` tells the kernel how it will be read (see madvise), by default
+    // from start to end, so that it reads ahead.
+    static MappedFile open(const std::string& path, int advice = MADV_SEQUENTIAL) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd == -1) throw error("could not open", path);
+
+        struct stat status;
+        if(fstat(fd, &status) == -1) {
+            ::close(fd);
+            throw error("could not stat", path);
+        }
+
+        size_t size = status.st_size;
+        void* data = size == 0 ? nullptr : mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(data == MAP_FAILED) throw error("could not map", path);
+        if(data != nullptr) madvise(data, size, advice);
+
+        return MappedFile{data, size};
+    }
+
+    // tells the kernel that the given range will not be needed for a while,
+    // so it drops it from the resident set of the process. The contents stay
+    // in the file and are read back on the next access.
+    void release(size_t offset, size_t size) {
+        const size_t page = sysconf(_SC_PAGESIZE);
+        size_t first = (offset + page - 1) / page * page;
+        size_t last = (offset + size) / page * page;
+        if(first < last) madvise(bytes() + first, last - first, MADV_DONTNEED);
+    }
+
+    uint8_t* bytes() { return static_cast<uint8_t*>(data); }
+    const uint8_t* bytes() const { return static_cast<const uint8_t*>(data); }
+    size_t size() const { return length; }
+};
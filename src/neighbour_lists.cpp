@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+// For every city, the k cities nearest to it in each direction: the ones it
+// is cheapest to go to, and the ones it is cheapest to come from. The
+// heuristics only try moves that add one of those edges, or try them first.
+// Forbidden edges are never in the lists. A city with fewer than k allowed
+// edges in a direction has the last of them repeated to fill its list.
+struct NeighbourLists {
+    int k = 0;
+    // out[u * k + i] is the i-th nearest city that u goes to
+    std::vector<int> out;
+    // in[u * k + i] is the i-th nearest city that goes to u
+    std::vector<int> in;
+
+    // Builds the lists in O(n^2 log k): every row and column of the matrix is
+    // scanned once, keeping the k nearest cities so far in a max-heap. The
+    // columns of a `symmetric` matrix are its rows, so they're skipped.
+    template <typename Distances>
+    NeighbourLists(const Distances& adjMatrix, int n, int _k, bool symmetric = false) :
+        k(std::max(0, std::min(_k, n - 1)))
+    {
+        out.resize(n * k);
+        in.resize(n * k);
+
+        // instances given by coordinates are symmetric and have a k-d tree,
+        // so the lists don't take O(n^2) there
+        if constexpr (requires { adjMatrix.nearest(0, 0, (int*)nullptr); }) {
+            for (int u = 0; u < n; u++) adjMatrix.nearest(u, k, &out[u * k]);
+            in = out;
+            return;
+        }
+
+        std::vector<std::pair<int64_t, int>> nearest;
+        nearest.reserve(k + 1);
+        for (int u = 0; u < n && k > 0; u++) {
+            for (int direction = 0; direction < (symmetric ? 1 : 2); direction++) {
+                nearest.clear();
+                for (int v = 0; v < n; v++) {
+                    if (direction == 0 ? adjMatrix.forbidden(u, v) : adjMatrix.forbidden(v, u)) continue;
+                    int64_t cost = direction == 0 ? adjMatrix(u, v) : adjMatrix(v, u);
+                    if (int(nearest.size()) == k) {
+                        if (cost >= nearest.front().first) continue;
+                        std::pop_heap(nearest.begin(), nearest.end());
+                        nearest.pop_back();
+                    }
+                    nearest.push_back({cost, v});
+                    std::push_heap(nearest.begin(), nearest.end());
+                }
+                std::sort_heap(nearest.begin(), nearest.end());
+                // a city without any allowed edge is on no tour, its list
+                // only has to hold some other city
+                if (nearest.empty()) nearest.push_back({0, (u + 1) % n});
+                int* list = &(direction == 0 ? out : in)[u * k];
+                for (int i = 0; i < k; i++) list[i] = nearest[std::min<int>(i, nearest.size() - 1)].second;
+            }
+        }
+        if (symmetric) in = out;
+    }
+};
+
+// number of cities in the candidate lists of an instance
+const int CANDIDATE_NEIGHBOURS = 10;
+
+// The candidate lists of an instance (NeighbourLists of CANDIDATE_NEIGHBOURS
+// cities), built the first time they're asked for. The first call is safe to
+// make from many threads, and the lists are then shared by all the copies of
+// the instance, so every solver and thread uses the same ones.
+class CandidateLists {
+    struct Cache {
+        std::once_flag built;
+        std::unique_ptr<NeighbourLists> lists;
+        double seconds = 0;
+    };
+    std::shared_ptr<Cache> cache = std::make_shared<Cache>();
+
+public:
+    template <typename Distances>
+    const NeighbourLists& get(const Distances& adjMatrix, bool symmetric) const {
+        std::call_once(cache->built, [&] {
+            auto start = std::chrono::steady_clock::now();
+            cache->lists = std::make_unique<NeighbourLists>(adjMatrix, adjMatrix.size(), CANDIDATE_NEIGHBOURS, symmetric);
+            cache->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+        return *cache->lists;
+    }
+
+    // how long building the lists took, 0 if they haven't been built yet
+    double buildSeconds() const {
+        return cache->seconds;
+    }
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+// The random number generator of the stochastic solvers: xoshiro256**. It's a
+// lot faster than std::mt19937 and has 32 bytes of state instead of 5 KB, so
+// every thread or worker of a solver can have its own. Workers get separate
+// streams of the same seed, which never overlap, so that a run is determined
+// by its seed and the number of workers.
+//
+// It can be used with the standard distributions and algorithms, but the hot
+// loops use `below` and `uniform`, which are cheaper.
+class Rng {
+    uint64_t state[4];
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    // spreads the seed over the state, so that similar seeds give unrelated
+    // streams (splitmix64)
+    static uint64_t splitmix(uint64_t& x) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    // advances the generator by 2^128 steps
+    void jump() {
+        static const uint64_t JUMP[] = {
+            0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+        uint64_t jumped[4] = { 0, 0, 0, 0 };
+        for (uint64_t word : JUMP) {
+            for (int bit = 0; bit < 64; bit++) {
+                if (word & (uint64_t(1) << bit)) {
+                    for (int i = 0; i < 4; i++) jumped[i] ^= state[i];
+                }
+                (*this)();
+            }
+        }
+        for (int i = 0; i < 4; i++) state[i] = jumped[i];
+    }
+
+public:
+    using result_type = uint64_t;
+
+    explicit Rng(uint64_t seed = 0) {
+        for (uint64_t& word : state) word = splitmix(seed);
+    }
+
+    // the generator of stream number `stream` of the seed
+    static Rng stream(uint64_t seed, uint64_t stream) {
+        Rng rng(seed);
+        for (uint64_t i = 0; i < stream; i++) rng.jump();
+        return rng;
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()() {
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    // a uniform integer in [0, bound), with Lemire's multiply and shift, which
+    // only needs a division in the rare case that the result would be biased
+    uint32_t below(uint32_t bound) {
+        uint64_t product = uint64_t(uint32_t((*this)() >> 32)) * bound;
+        uint32_t low = uint32_t(product);
+        if (low < bound) {
+            uint32_t threshold = -bound % bound;
+            while (low < threshold) {
+                product = uint64_t(uint32_t((*this)() >> 32)) * bound;
+                low = uint32_t(product);
+            }
+        }
+        return product >> 32;
+    }
+
+    // a uniform integer in [low, high]
+    int between(int low, int high) {
+        return low + int(below(uint32_t(high - low + 1)));
+    }
+
+    // a uniform real number in [0, 1)
+    double uniform() {
+        return ((*this)() >> 11) * 0x1.0p-53;
+    }
+};
+
+// a seed for a run that wasn't given one
+uint64_t randomSeed() {
+    std::random_device rd;
+    return (uint64_t(rd()) << 32) | rd();
+}
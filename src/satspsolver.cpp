@@ -1,90 +1,307 @@
 #pragma once
 
 #include "tspsolver.cpp"
+#include "tour.cpp"
+#include "heuristic_tour.cpp"
+#include "thread_pool.cpp"
 #include <random>
 #include <chrono>
+#include <cmath>
 
-class SaTspSolver : public TspSolver {
-public:
-    SaTspSolver(const Tsp& instance) : TspSolver(instance) {}
+// One Markov chain of the annealing: the current tour, the best one it has
+// been in, and the random generator of its moves. Chains don't share anything
+// they change, so that a few of them can be run on separate threads. The
+// Symmetric tag makes the reversals cost O(1) to evaluate (see Tour).
+template <typename Instance, typename Symmetry = Asymmetric>
+class SaChain {
+    using SaTour = Tour<Instance, Symmetry>;
 
-    TspSolution solve(int start, float timeoutS) override {
-        auto startTime = std::chrono::system_clock::now();
-        int timeoutMs = timeoutS * 1000;
+    Rng rng;
+    SaTour current;
+    SaTour best;
+    // the candidate lists of the instance, nullptr for uniform moves only
+    const NeighbourLists* candidates;
+    // share of the moves that are drawn from them
+    double candidateMoves;
 
-        Tsp tsp = getTsp();
+    // the last move picked
+    int moveType = 0, a = 0, b = 0, count = 0;
 
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> cityDist(1, tsp.size()-1);
-        std::uniform_real_distribution<> realDist(0.0, 1.0);
+    // share of the moves that add an edge from the candidate lists, on an
+    // instance without forbidden edges. On one with them, uniform moves
+    // nearly always add one, so they're only made when there's no
+    // candidate move.
+    static constexpr double CANDIDATE_MOVES = 0.75;
 
+    // a random tour beginning in `start`, which only takes allowed arcs if
+    // there's such a tour to be found (see tourAlongArcs)
+    static std::vector<int> randomTour(const Instance& tsp, int start, Rng& rng) {
         int n = tsp.size();
+        std::vector<int> order(n);
+        if(tsp.hasForbiddenEdges() && tourAlongArcs(tsp.getAdjMatrix(), n, start, rng, false, order.data())) {
+            order.push_back(start);
+            return order;
+        }
 
-        // Define a move operation that swaps two arbitrary cities in a given solution
-        auto moveSwap = [&](const std::vector<int>& order, int a, int b) {
-            // don't do anything when requesting OOB swap. Maybe we should fail here.
-            if(a >= order.size() - 1 || b >= order.size() - 1) {
-                return order;
+        order.at(0) = start;
+        int val = 0;
+        for(auto c = order.begin() + 1; c != order.end(); ++c) {
+            if(val == start) {
+                val++;
             }
+            *c = val++;
+        }
+
+        // shuffle the sequence after start city
+        std::shuffle(order.begin() + 1, order.end(), rng);
+        order.push_back(start);
+        return order;
+    }
+
+    void pickUniformMove(int n) {
+        a = rng.between(1, n - 1);
+        b = rng.between(1, n - 1);
+        while(b == a) b = rng.between(1, n - 1);
+
+        if(moveType == 1) {
+            // move a segment of up to 3 cities starting at a behind b,
+            // which has to lie outside of it
+            count = std::min(rng.between(1, 3), n - a);
+            if(b >= a - 1 && b < a + count) moveType = 0;
+        }
+    }
+
+    // Picks a move of the current type that makes a random city u go to one
+    // of its candidates v next. Returns false if there's no such move.
+    bool pickCandidateMove(int n) {
+        int u = rng.between(1, n - 1);
+        int city = current.cities()[u];
+        int v = current.positionOf(candidates->out[city * candidates->k + rng.below(candidates->k)]);
+        if(v == 0 || v == u + 1) return false;
+
+        switch(moveType) {
+        case 0:
+            // v swaps with the city after u
+            if(u == n - 1) return false;
+            a = u + 1;
+            b = v;
+            return true;
+        case 1:
+            // a segment starting at v moves behind u
+            a = v;
+            b = u;
+            count = std::min(rng.between(1, 3), n - v);
+            return b < a - 1 || b >= a + count;
+        default:
+            // the cities after u up to v are reversed, or the ones from v up
+            // to the one before u, which makes v go to u instead
+            a = v > u ? u + 1 : v;
+            b = v > u ? v : u - 1;
+            return a < b;
+        }
+    }
+
+public:
+    // Starts from a random tour beginning in `start`. Most of the moves are
+    // drawn from the candidate lists of the instance, unless `useCandidates`
+    // is false.
+    SaChain(const Instance& tsp, int start, const Rng& _rng, bool useCandidates = true) :
+        rng(_rng),
+        current(tsp, randomTour(tsp, start, rng)),
+        best(current),
+        candidates(useCandidates && tsp.size() > 4 ? &tsp.candidates() : nullptr),
+        candidateMoves(tsp.hasForbiddenEdges() ? 1 : CANDIDATE_MOVES) {}
 
-            // if access within bounds, swap cities at indices a and b
-            auto nextOrder = order;
-            std::swap(nextOrder.at(a), nextOrder.at(b));
-            return nextOrder;
-        };
-
-        // initialize vector to a sequence
-        std::vector<int> currentOrder(tsp.size());
-        currentOrder.at(0) = start;
-        {
-            int val = 0;
-            for(auto c = currentOrder.begin()+1; c != currentOrder.end(); ++c) {
-                if(val == start) {
-                    val++;
+    const SaTour& tour() const { return current; }
+    const SaTour& bestTour() const { return best; }
+
+    void restoreBest() {
+        current = best;
+    }
+
+    // Picks a random move and returns the change of cost it would make,
+    // without making it yet. `apply` makes the last move picked.
+    int64_t pickMove() {
+        int n = current.size();
+        moveType = n > 3 ? rng.below(3) : 0;
+        if(!candidates || rng.uniform() >= candidateMoves || !pickCandidateMove(n)) {
+            pickUniformMove(n);
+        }
+
+        switch(moveType) {
+        case 0:
+            return current.swapDelta(a, b);
+        case 1:
+            return current.insertDelta(a, count, b);
+        default:
+            return current.reverseDelta(a, b);
+        }
+    }
+
+    void apply() {
+        switch(moveType) {
+        case 0:
+            current.swap(a, b);
+            break;
+        case 1:
+            current.insert(a, count, b);
+            break;
+        default:
+            current.reverse(a, b);
+            break;
+        }
+    }
+
+    // makes `steps` steps of the Metropolis algorithm at temperature t
+    void run(long steps, double t) {
+        for(long i = 0; i < steps; ++i) {
+            int64_t delta = pickMove();
+
+            // the move is only made once it's accepted
+            if(delta < 0 || rng.uniform() < exp(-delta / t)) {
+                apply();
+
+                if(current.cost() < best.cost()) {
+                    best = current;
                 }
-                *c = val++;
             }
         }
+    }
 
-        // shuffle the sequence after start city
-        std::shuffle(currentOrder.begin() + 1, currentOrder.end(), gen);
-        currentOrder.push_back(0);
-        int currentCost = tsp.cost(currentOrder);
-
-        // find best starting solution using greedy method
-        bool minimal = true;
-        while(!minimal) {
-            minimal = true;
-            for(int a = 1; a < n-1; ++a) {
-                for(int b = 2; b < n; ++b) {
-                    auto nextOrder = moveSwap(currentOrder, a, b);
-                    auto nextCost = tsp.cost(currentOrder);
-
-                    if(nextCost < currentCost) {
-                        currentCost = nextCost;
-                        currentOrder = nextOrder;
-                        minimal = false;
-                    }
+    // mean cost increase of `samples` random moves that make the tour worse,
+    // leaving out the ones that add a forbidden edge
+    double meanUphillDelta(int samples) {
+        double sum = 0;
+        int uphill = 0;
+        for(int i = 0; i < samples; ++i) {
+            int64_t delta = pickMove();
+            if(delta > 0 && delta < FORBIDDEN_EDGE_PENALTY / 2) {
+                sum += delta;
+                ++uphill;
+            }
+        }
+        return uphill == 0 ? 1 : sum / uphill;
+    }
+};
+
+template <typename Instance, typename Symmetry = Asymmetric>
+class SaTspSolver : public TspSolver<Instance> {
+    using Chain = SaChain<Instance, Symmetry>;
+
+    using TspSolver<Instance>::getTsp;
+    using TspSolver<Instance>::rng;
+
+    int replicas;
+    int threads;
+
+    // Parameters of parallel tempering. The temperatures of the replicas go
+    // geometrically from the mean cost of a bad move, at which most of them
+    // are still accepted, down to TEMPERING_COLDEST of it, where almost only
+    // improvements are. Replicas at neighbouring temperatures try to trade
+    // their tours every TEMPERING_ROUND_STEPS steps.
+    static constexpr double TEMPERING_COLDEST = 0.002;
+    static constexpr long TEMPERING_ROUND_STEPS = 20000;
+
+    // the solution of a tour, which is no tour at all (of cost INT32_MAX) if
+    // it still takes a forbidden edge
+    static TspSolution solution(const Tour<Instance, Symmetry>& tour) {
+        if(tour.cost() >= FORBIDDEN_EDGE_PENALTY / 2) return TspSolution{tour.cities(), INT32_MAX};
+        return TspSolution{tour.cities(), tour.cost()};
+    }
+
+    TspSolution solveTempering(int start, float timeoutS) {
+        auto startTime = std::chrono::system_clock::now();
+        auto deadline = startTime + std::chrono::milliseconds(long(timeoutS * 1000));
+        const Instance& tsp = getTsp();
+
+        // the trades are decided by stream 0, every chain has its own
+        Rng trades = rng(0);
+        std::vector<Chain> chains;
+        for(int i = 0; i < replicas; ++i) {
+            chains.emplace_back(tsp, start, rng(i + 1));
+        }
+
+        // the temperature at each level of the ladder, from the hottest one,
+        // and the chain that is at each level
+        double hottest = chains[0].meanUphillDelta(1000);
+        std::vector<double> temperature(replicas);
+        std::vector<int> chainAt(replicas);
+        for(int level = 0; level < replicas; ++level) {
+            temperature[level] = hottest * std::pow(TEMPERING_COLDEST, double(level) / (replicas - 1));
+            chainAt[level] = level;
+        }
+
+        std::ofstream f("costs.csv");
+
+        ThreadPool pool(threads);
+        long rounds = 0;
+        long swaps = 0;
+        Tour<Instance, Symmetry> best = chains[0].bestTour();
+
+        while(std::chrono::system_clock::now() < deadline) {
+            // the chains only touch their own state, so nothing is locked
+            // while they run
+            pool.parallelFor(replicas, [&](size_t level) {
+                chains[chainAt[level]].run(TEMPERING_ROUND_STEPS, temperature[level]);
+            });
+            ++rounds;
+
+            // Metropolis rule for trading the tours of neighbouring levels: a
+            // hotter chain that found a cheaper tour always hands it down
+            int first = rounds % 2;
+            for(int level = first; level + 1 < replicas; level += 2) {
+                const Chain& hot = chains[chainAt[level]];
+                const Chain& cold = chains[chainAt[level + 1]];
+                double exponent = (1 / temperature[level + 1] - 1 / temperature[level])
+                    * double(cold.tour().cost() - hot.tour().cost());
+                if(exponent >= 0 || trades.uniform() < exp(exponent)) {
+                    std::swap(chainAt[level], chainAt[level + 1]);
+                    ++swaps;
+                }
+            }
+
+            for(const Chain& chain: chains) {
+                if(chain.bestTour().cost() < best.cost()) {
+                    best = chain.bestTour();
                 }
             }
+            f << chains[chainAt[replicas - 1]].tour().cost() << "\n";
         }
 
+        std::cout << "rounds: " << rounds << ", accepted swaps: " << swaps << std::endl;
+        std::cout << "iterations: " << rounds * replicas * TEMPERING_ROUND_STEPS << std::endl;
+        return solution(best);
+    }
+
+public:
+    // With more than one replica, the chains are run at a ladder of fixed
+    // temperatures on `threads` threads (0 means all hardware threads),
+    // swapping their tours from time to time (parallel tempering). One replica
+    // is a single chain that cools down.
+    SaTspSolver(const Instance& instance, int _replicas = 1, int _threads = 0) :
+        TspSolver<Instance>(instance), replicas(_replicas), threads(_threads) {}
+
+    TspSolution solve(int start, float timeoutS) override {
+        if(replicas > 1) {
+            return solveTempering(start, timeoutS);
+        }
+
+        auto startTime = std::chrono::system_clock::now();
+        int timeoutMs = timeoutS * 1000;
+
+        Chain chain(getTsp(), start, rng());
+
         float t = 40000;
         float t_min = 0.01;
         float alpha = 0.999;
-        int iterations = 0;
-        int era_length = n * n;
+        long iterations = 0;
 
         std::cout << "starting: ";
-        printVec(currentOrder);
-        std::cout << "cost: " << currentCost << std::endl;
-
-        auto bestOrder = currentOrder;
-        int bestCost = currentCost;
+        printVec(chain.tour().cities());
+        std::cout << "cost: " << chain.tour().cost() << std::endl;
 
         int same = 0;
-        int prev = 0;
+        int64_t prev = 0;
 
         std::ofstream f("costs.csv");
 
@@ -93,52 +310,31 @@ public:
             auto durationMs = std::chrono::duration_cast<std::chrono::milliseconds>(time - startTime).count();
             if(durationMs > timeoutMs) {
                 std::cout << "aborting due to hitting timeout" <<std::endl;
-                return TspSolution{bestOrder, bestCost};
+                std::cout << "iterations: " << iterations << std::endl;
+                const Tour<Instance, Symmetry>& best = chain.bestTour();
+                return solution(best);
             }
-            if(prev == currentCost)
+            if(prev == chain.tour().cost())
                 ++same;
             else
                 same = 0;
-            prev = currentCost;
-
-            for(int i = 0; i < 100000; ++i) {
-                ++iterations;
-                int a = cityDist(gen);
-                int b = cityDist(gen);
-                while(b == a) b = cityDist(gen);
-
-                auto nextOrder = moveSwap(currentOrder, a, b);
-                auto nextCost = tsp.cost(nextOrder);
-                float prob = exp((-(nextCost - currentCost) / t));
-
-                if(nextCost < currentCost || realDist(gen) < prob) {
-                    currentCost = nextCost;
-                    currentOrder = nextOrder;
-
-                    if(currentCost < bestCost) {
-                        bestCost = currentCost;
-                        bestOrder = currentOrder;
-                    }
-                }
-            }
-            f << currentCost << "\n";
+            prev = chain.tour().cost();
+
+            chain.run(100000, t);
+            iterations += 100000;
+            f << chain.tour().cost() << "\n";
             t = t * alpha;
 
             // if stuck at the solution worse than best found so far, take the
             // best one as the current one and continue the algorithm
-            if(same >= 1000 && currentCost > bestCost) {
-                if(currentCost == bestCost) {
-                    return TspSolution{currentOrder, currentCost};
-                }
-                else {
-                    currentOrder = bestOrder;
-                    currentCost = bestCost;
-                    same = 0;
-                }
+            if(same >= 1000 && chain.tour().cost() > chain.bestTour().cost()) {
+                chain.restoreBest();
+                same = 0;
             }
         }
         std::cout << "iterations: " << iterations << std::endl;
 
-        return TspSolution{currentOrder, currentCost};
+        const Tour<Instance, Symmetry>& current = chain.tour();
+        return solution(current);
     }
-};
\ No newline at end of file
+};
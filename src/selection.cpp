@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <random>
+#include <algorithm>
+
+#include "rng.cpp"
+
+// Picking the parents of the genetic algorithm. Whatever a method needs is
+// built once per generation by `prepare`, after which every parent is picked
+// in O(1), so that the cost doesn't grow with the size of the population.
+
+enum class GaSelection {
+    // fitness proportional: the chance of a tour grows linearly from 0 for
+    // the worst one of the population to the largest for the best one
+    Roulette,
+    // the best of a few tours picked at random
+    Tournament,
+};
+
+const char* gaSelectionName(GaSelection selection) {
+    switch (selection) {
+    case GaSelection::Tournament:
+        return "tournament";
+    default:
+        return "roulette";
+    }
+}
+
+class Selection {
+    GaSelection kind;
+    int tournamentSize;
+
+    const int64_t* costs = nullptr;
+    int size = 0;
+
+    // Walker's alias table of the roulette: an index picked at random is
+    // kept with chance `keep`, otherwise it's replaced with its alias
+    std::vector<double> keep;
+    std::vector<int> alias;
+    std::vector<int> small, large;
+
+    // builds the alias table with Vose's method, O(size)
+    void prepareRoulette() {
+        int64_t worst = *std::max_element(costs, costs + size);
+        double total = 0;
+        for (int i = 0; i < size; i++) {
+            total += worst - costs[i];
+        }
+
+        small.clear();
+        large.clear();
+        for (int i = 0; i < size; i++) {
+            // all the tours cost the same, so they're all as likely
+            keep[i] = total == 0 ? 1.0 : double(worst - costs[i]) * size / total;
+            alias[i] = i;
+            (keep[i] < 1.0 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            int less = small.back();
+            int more = large.back();
+            small.pop_back();
+            alias[less] = more;
+            keep[more] -= 1.0 - keep[less];
+            if (keep[more] < 1.0) {
+                large.pop_back();
+                small.push_back(more);
+            }
+        }
+        // what's left is 1 up to rounding errors
+        for (int i : small) keep[i] = 1.0;
+        for (int i : large) keep[i] = 1.0;
+    }
+
+public:
+    Selection(GaSelection _kind, int populationSize, int _tournamentSize) :
+        kind(_kind), tournamentSize(std::max(1, _tournamentSize))
+    {
+        if (kind == GaSelection::Roulette) {
+            keep.resize(populationSize);
+            alias.resize(populationSize);
+            small.reserve(populationSize);
+            large.reserve(populationSize);
+        }
+    }
+
+    // prepares picking from a population with the given costs, which must
+    // stay the same until the next call
+    void prepare(const std::vector<int64_t>& populationCosts) {
+        costs = populationCosts.data();
+        size = populationCosts.size();
+        if (kind == GaSelection::Roulette) prepareRoulette();
+    }
+
+    // returns the index of a parent
+    int pick(Rng& rng) const {
+        if (kind == GaSelection::Tournament) {
+            int best = rng.below(size);
+            for (int i = 1; i < tournamentSize; i++) {
+                int other = rng.below(size);
+                if (costs[other] < costs[best]) best = other;
+            }
+            return best;
+        }
+
+        int i = rng.below(size);
+        return rng.uniform() < keep[i] ? i : alias[i];
+    }
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+// Tags of the two kinds of instances the solvers are specialized for. On a
+// symmetric instance every edge weighs the same in both directions, so a tour
+// costs the same both ways around, and a solver given the Symmetric tag
+// relies on that: its symmetric code is picked when it's compiled, so neither
+// kind of instance pays for a check of which one it is.
+struct Asymmetric {
+    static constexpr bool symmetric = false;
+};
+
+struct Symmetric {
+    static constexpr bool symmetric = true;
+};
+
+// calls `solve` with the tag of the instance, symmetric or not
+template <typename F>
+auto withSymmetry(bool symmetric, F&& solve) {
+    return symmetric ? solve(Symmetric{}) : solve(Asymmetric{});
+}
+
+// whether every edge of the n cities weighs the same in both directions
+template <typename Distances>
+bool isSymmetricMatrix(const Distances& adjMatrix, int n) {
+    for (int from = 0; from < n; ++from) {
+        for (int to = 0; to < from; ++to) {
+            if (adjMatrix(from, to) != adjMatrix(to, from)) return false;
+        }
+    }
+    return true;
+}
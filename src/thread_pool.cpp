@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+
+// A fixed set of worker threads that run data-parallel loops. The thread that
+// calls `parallelFor` takes part in the work as well, so a pool of size 1 has
+// no background threads and runs everything inline.
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    // the loop currently being executed, valid while `running > 0`
+    const std::function<void(size_t)>* task = nullptr;
+    size_t tasks = 0;
+    std::atomic<size_t> nextTask{0};
+
+    // incremented for every loop, so that the workers can tell a new loop from
+    // a spurious wakeup
+    size_t generation = 0;
+    int running = 0;
+    bool stopping = false;
+
+    // claims tasks one by one until all of them are taken
+    void work() {
+        for(size_t i = nextTask++; i < tasks; i = nextTask++) {
+            (*task)(i);
+        }
+    }
+
+    void workerLoop() {
+        size_t seen = 0;
+        while(true) {
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if(stopping) return;
+                seen = generation;
+            }
+
+            work();
+
+            std::unique_lock lock(mutex);
+            if(--running == 0) finished.notify_one();
+        }
+    }
+
+public:
+    // 0 threads means one thread for every hardware thread of the machine
+    explicit ThreadPool(int threads) {
+        if(threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for(int i = 1; i < threads; ++i) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::unique_lock lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto& worker: workers) worker.join();
+    }
+
+    int size() const { return workers.size() + 1; }
+
+    // calls `f(i)` for every i in [0, count) and returns once all the calls
+    // are done. Tasks are handed out dynamically, so they should be coarse
+    // enough that claiming one is cheap compared to running it.
+    void parallelFor(size_t count, const std::function<void(size_t)>& f) {
+        if(workers.empty() || count <= 1) {
+            for(size_t i = 0; i < count; ++i) f(i);
+            return;
+        }
+
+        {
+            std::unique_lock lock(mutex);
+            task = &f;
+            tasks = count;
+            nextTask = 0;
+            running = workers.size() + 1;
+            ++generation;
+        }
+        wake.notify_all();
+
+        work();
+
+        std::unique_lock lock(mutex);
+        --running;
+        finished.wait(lock, [&] { return running == 0; });
+        task = nullptr;
+    }
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "lib.h"
+
+// A tour that local search heuristics change with small moves. Every move can
+// be evaluated in constant time, without changing the tour, so that only the
+// moves that are accepted have to be applied.
+//
+// The tour is kept as n + 1 cities, with the start city at both ends. Only
+// positions 1 .. n - 1 are moved around. On an asymmetric instance reversing
+// a part of the tour changes the cost of every edge in it. To get that in
+// constant time, the tour keeps prefix sums of its edges in both directions.
+// Moves other than reversals don't need them, so after a move they're only
+// marked as stale from the first position that changed, and brought up to
+// date when a reversal is evaluated. With the Symmetric tag a reversal only
+// changes the two edges at its ends (2-opt), and there are no prefix sums.
+// Forbidden edges count as FORBIDDEN_EDGE_PENALTY, so a tour that takes one
+// costs at least that much.
+template <typename Instance, typename Symmetry = Asymmetric>
+class Tour {
+    const Instance& tsp;
+    int n;
+    std::vector<int> order;
+    // position[c] is where city c is in `order`, the first one for the start
+    std::vector<int> position;
+    int64_t length;
+
+    // forward[k] is the cost of the edges order[0] -> ... -> order[k], and
+    // backward[k] of order[k] -> ... -> order[0]
+    std::vector<int64_t> forward;
+    std::vector<int64_t> backward;
+    int staleFrom = 0;
+
+    // forbidden edges count as FORBIDDEN_EDGE_PENALTY, so that a move that
+    // adds one is never accepted
+    int64_t d(int from, int to) const {
+        return penalizedWeight(tsp.get(to, from));
+    }
+
+    int64_t edge(int at) const {
+        return d(order[at], order[at + 1]);
+    }
+
+    void markStale(int from) {
+        if constexpr(!Symmetry::symmetric) staleFrom = std::min(staleFrom, from);
+    }
+
+    void updatePositions(int from, int to) {
+        for(int k = from; k <= to; ++k) position[order[k]] = k;
+    }
+
+    void updatePrefixes(int upTo) {
+        if(staleFrom == 0) {
+            forward[0] = backward[0] = 0;
+            staleFrom = 1;
+        }
+        for(int k = staleFrom; k <= upTo; ++k) {
+            forward[k] = forward[k - 1] + d(order[k - 1], order[k]);
+            backward[k] = backward[k - 1] + d(order[k], order[k - 1]);
+        }
+        staleFrom = std::max(staleFrom, upTo + 1);
+    }
+
+public:
+    // `cities` is the tour as n + 1 cities, starting and ending in the same one
+    Tour(const Instance& _tsp, std::vector<int> cities) :
+        tsp(_tsp),
+        n(cities.size() - 1),
+        order(std::move(cities)),
+        position(n),
+        forward(Symmetry::symmetric ? 0 : n + 1),
+        backward(Symmetry::symmetric ? 0 : n + 1)
+    {
+        updatePositions(0, n - 1);
+        length = 0;
+        for(int i = 0; i < n; ++i) length += edge(i);
+    }
+
+    Tour(const Tour& other) = default;
+
+    Tour& operator=(const Tour& other) {
+        order = other.order;
+        position = other.position;
+        length = other.length;
+        forward = other.forward;
+        backward = other.backward;
+        staleFrom = other.staleFrom;
+        return *this;
+    }
+
+    int64_t cost() const { return length; }
+    const std::vector<int>& cities() const { return order; }
+    int size() const { return n; }
+
+    // the position of `city` in the tour, 0 for the start city
+    int positionOf(int city) const { return position[city]; }
+
+    // change of the cost after swapping the cities at positions a and b
+    int64_t swapDelta(int a, int b) const {
+        if(a > b) std::swap(a, b);
+        int pa = order[a - 1], ca = order[a], na = order[a + 1];
+        int pb = order[b - 1], cb = order[b], nb = order[b + 1];
+
+        if(b == a + 1) {
+            return d(pa, cb) + d(cb, ca) + d(ca, nb)
+                - d(pa, ca) - d(ca, cb) - d(cb, nb);
+        }
+        return d(pa, cb) + d(cb, na) + d(pb, ca) + d(ca, nb)
+            - d(pa, ca) - d(ca, na) - d(pb, cb) - d(cb, nb);
+    }
+
+    void swap(int a, int b) {
+        length += swapDelta(a, b);
+        std::swap(order[a], order[b]);
+        position[order[a]] = a;
+        position[order[b]] = b;
+        markStale(std::min(a, b));
+    }
+
+    // Change of the cost after moving the `count` cities starting at position
+    // `first` so that they follow the city at position `after`, which must lie
+    // outside of them. The segment keeps its direction (or-opt).
+    int64_t insertDelta(int first, int count, int after) const {
+        int last = first + count - 1;
+        int before = order[first - 1];
+        int next = order[last + 1];
+        return d(before, next) + d(order[after], order[first]) + d(order[last], order[after + 1])
+            - d(before, order[first]) - d(order[last], next) - d(order[after], order[after + 1]);
+    }
+
+    void insert(int first, int count, int after) {
+        length += insertDelta(first, count, after);
+        auto begin = order.begin();
+        if(after < first) {
+            std::rotate(begin + after + 1, begin + first, begin + first + count);
+            updatePositions(after + 1, first + count - 1);
+            markStale(after + 1);
+        }
+        else {
+            std::rotate(begin + first, begin + first + count, begin + after + 1);
+            updatePositions(first, after);
+            markStale(first);
+        }
+    }
+
+    // change of the cost after reversing the cities at positions i .. j
+    int64_t reverseDelta(int i, int j) {
+        if(i > j) std::swap(i, j);
+        if constexpr(Symmetry::symmetric) {
+            return d(order[i - 1], order[j]) + d(order[i], order[j + 1])
+                - d(order[i - 1], order[i]) - d(order[j], order[j + 1]);
+        }
+        updatePrefixes(j);
+        int64_t inside = forward[j] - forward[i];
+        int64_t reversed = backward[j] - backward[i];
+        return d(order[i - 1], order[j]) + d(order[i], order[j + 1]) + reversed
+            - d(order[i - 1], order[i]) - d(order[j], order[j + 1]) - inside;
+    }
+
+    void reverse(int i, int j) {
+        if(i > j) std::swap(i, j);
+        length += reverseDelta(i, j);
+        std::reverse(order.begin() + i, order.begin() + j + 1);
+        updatePositions(i, j);
+        markStale(i);
+    }
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <immintrin.h>
+
+#include "distance_matrix.cpp"
+#include "thread_pool.cpp"
+
+// Scoring many tours at once. The cost of a tour is the sum of the weights of
+// the edges between its consecutive cities, plus the edge from its last city
+// back to the first one if it's `closed`. A batch is `count` tours of `length`
+// cities each, stored one after another, the way the genetic algorithm keeps
+// a generation; a single tour is a batch of one. Costs are added up in 64
+// bits, as the tours of the large instances given by coordinates cost more
+// than fits in an int.
+//
+// The vector kernels score 8 or 16 edges of a tour at once, gathering their
+// weights from a DistanceMatrix by the index from * stride + to. 16 bit weights
+// are gathered 32 bits at a time and sign extended from the lower half. The
+// upper half is the next weight, which is still in the matrix, as the edges
+// of a tour never go from a city to itself and the last weight of the matrix
+// is on the diagonal. The weights are widened to 64 bits before they're added
+// up, 4 or 8 lanes at a time.
+
+enum class TourCostKernel { Auto, Scalar, Avx2, Avx512 };
+
+template <typename Weight>
+using TourCostFunction = void (*)(const DistanceMatrix<Weight>& adjMatrix, const int* tours, size_t count,
+    int length, bool closed, int64_t* costs);
+
+// batches of at least this many edges are split between the threads of the
+// pool given to tourCosts, in chunks of about TOUR_COST_CHUNK_EDGES edges
+const size_t TOUR_COST_PARALLEL_EDGES = 1 << 16;
+const size_t TOUR_COST_CHUNK_EDGES = 1 << 14;
+
+// works with any Distances, including the ones computed from coordinates
+template <typename Distances>
+void tourCostsScalar(const Distances& adjMatrix, const int* tours, size_t count, int length, bool closed,
+        int64_t* costs) {
+    for (size_t t = 0; t < count; ++t) {
+        const int* tour = tours + t * length;
+        int64_t cost = closed && length > 0 ? adjMatrix(tour[length - 1], tour[0]) : 0;
+        for (int i = 0; i + 1 < length; ++i) cost += adjMatrix(tour[i], tour[i + 1]);
+        costs[t] = cost;
+    }
+}
+
+// the weights at `index` of the lanes that are on
+template <typename Weight>
+__attribute__((target("avx2")))
+__m256i gatherWeightsAvx2(const Weight* weights, __m256i index, __m256i lanes) {
+    const int* base = reinterpret_cast<const int*>(weights);
+    __m256i gathered = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, index, lanes, sizeof(Weight));
+    if constexpr (sizeof(Weight) == sizeof(int32_t)) return gathered;
+    else return _mm256_srai_epi32(_mm256_slli_epi32(gathered, 16), 16);
+}
+
+// adds the 8 weights of `weights` to the 4 lanes of 64 bits of `sum`
+__attribute__((target("avx2")))
+inline __m256i addWidenedAvx2(__m256i sum, __m256i weights) {
+    sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(weights)));
+    return _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(weights, 1)));
+}
+
+template <typename Weight>
+__attribute__((target("avx2")))
+void tourCostsAvx2(const DistanceMatrix<Weight>& adjMatrix, const int* tours, size_t count, int length,
+        bool closed, int64_t* costs) {
+    const Weight* weights = adjMatrix.row(0);
+    const __m256i stride = _mm256_set1_epi32(adjMatrix.stride());
+    const __m256i allLanes = _mm256_set1_epi32(-1);
+    const int edges = length - 1;
+
+    for (size_t t = 0; t < count; ++t) {
+        const int* tour = tours + t * length;
+        __m256i sum = _mm256_setzero_si256();
+
+        int i = 0;
+        for (; i + 8 <= edges; i += 8) {
+            __m256i from = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tour + i));
+            __m256i to = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tour + i + 1));
+            __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(from, stride), to);
+            sum = addWidenedAvx2(sum, gatherWeightsAvx2(weights, index, allLanes));
+        }
+        // the remaining edges are read with masked loads and gathers, which
+        // don't touch the memory of the lanes that are switched off
+        if (i < edges) {
+            __m256i lanes = _mm256_cmpgt_epi32(_mm256_set1_epi32(edges - i),
+                _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            __m256i from = _mm256_maskload_epi32(tour + i, lanes);
+            __m256i to = _mm256_maskload_epi32(tour + i + 1, lanes);
+            __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(from, stride), to);
+            sum = addWidenedAvx2(sum, gatherWeightsAvx2(weights, index, lanes));
+        }
+
+        __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        half = _mm_add_epi64(half, _mm_unpackhi_epi64(half, half));
+        int64_t cost = _mm_cvtsi128_si64(half);
+        if (closed && length > 0) cost += adjMatrix(tour[length - 1], tour[0]);
+        costs[t] = cost;
+    }
+}
+
+template <typename Weight>
+__attribute__((target("avx512f")))
+void tourCostsAvx512(const DistanceMatrix<Weight>& adjMatrix, const int* tours, size_t count, int length,
+        bool closed, int64_t* costs) {
+    const int* base = reinterpret_cast<const int*>(adjMatrix.row(0));
+    const __m512i stride = _mm512_set1_epi32(adjMatrix.stride());
+    const int edges = length - 1;
+
+    for (size_t t = 0; t < count; ++t) {
+        const int* tour = tours + t * length;
+        __m512i sum = _mm512_setzero_si512();
+
+        for (int i = 0; i < edges; i += 16) {
+            __mmask16 lanes = edges - i >= 16 ? __mmask16(0xffff) : __mmask16((1u << (edges - i)) - 1);
+            __m512i from = _mm512_maskz_loadu_epi32(lanes, tour + i);
+            __m512i to = _mm512_maskz_loadu_epi32(lanes, tour + i + 1);
+            __m512i index = _mm512_add_epi32(_mm512_mullo_epi32(from, stride), to);
+            __m512i gathered = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), lanes, index, base, sizeof(Weight));
+            // the masked forms, here and below, as the others make gcc 12
+            // warn about the undefined register they start from
+            if constexpr (sizeof(Weight) != sizeof(int32_t)) {
+                gathered = _mm512_maskz_srai_epi32(lanes, _mm512_maskz_slli_epi32(lanes, gathered, 16), 16);
+            }
+            sum = _mm512_add_epi64(sum,
+                _mm512_maskz_cvtepi32_epi64(0xff, _mm512_maskz_extracti64x4_epi64(0xff, gathered, 0)));
+            sum = _mm512_add_epi64(sum,
+                _mm512_maskz_cvtepi32_epi64(0xff, _mm512_maskz_extracti64x4_epi64(0xff, gathered, 1)));
+        }
+
+        __m256i quarter = _mm256_add_epi64(_mm512_maskz_extracti64x4_epi64(0xff, sum, 0),
+            _mm512_maskz_extracti64x4_epi64(0xff, sum, 1));
+        __m128i half = _mm_add_epi64(_mm256_castsi256_si128(quarter), _mm256_extracti128_si256(quarter, 1));
+        half = _mm_add_epi64(half, _mm_unpackhi_epi64(half, half));
+        int64_t cost = _mm_cvtsi128_si64(half);
+        if (closed && length > 0) cost += adjMatrix(tour[length - 1], tour[0]);
+        costs[t] = cost;
+    }
+}
+
+// returns the requested kernel, or the widest one the CPU supports for Auto
+template <typename Weight>
+TourCostFunction<Weight> tourCostFunction(TourCostKernel kernel) {
+    if (kernel == TourCostKernel::Auto) {
+        if (__builtin_cpu_supports("avx512f")) kernel = TourCostKernel::Avx512;
+        else if (__builtin_cpu_supports("avx2")) kernel = TourCostKernel::Avx2;
+        else kernel = TourCostKernel::Scalar;
+    }
+
+    switch (kernel) {
+    case TourCostKernel::Avx512:
+        return tourCostsAvx512<Weight>;
+    case TourCostKernel::Avx2:
+        return tourCostsAvx2<Weight>;
+    default:
+        return tourCostsScalar<DistanceMatrix<Weight>>;
+    }
+}
+
+const char* tourCostKernelName(TourCostKernel kernel) {
+    switch (kernel) {
+    case TourCostKernel::Avx512:
+        return "avx512";
+    case TourCostKernel::Avx2:
+        return "avx2";
+    case TourCostKernel::Scalar:
+        return "scalar";
+    default:
+        return "auto";
+    }
+}
+
+// Writes the costs of the batch of tours to `costs`, with the widest kernel
+// the CPU supports for a DistanceMatrix, and the scalar loop for any other
+// Distances. A large batch is split between the threads of `pool`, if given.
+template <typename Distances>
+void tourCosts(const Distances& adjMatrix, const int* tours, size_t count, int length, bool closed, int64_t* costs,
+        ThreadPool* pool = nullptr, TourCostKernel kernel = TourCostKernel::Auto) {
+    if constexpr (requires { adjMatrix.stride(); }) {
+        // the indices of the gathers are 32 bit
+        if (uint64_t(adjMatrix.size()) * adjMatrix.stride() > INT32_MAX) kernel = TourCostKernel::Scalar;
+    }
+
+    auto score = [&](const int* batch, size_t batchCount, int64_t* batchCosts) {
+        if constexpr (requires { adjMatrix.stride(); }) {
+            using Weight = typename Distances::weight_type;
+            static const TourCostFunction<Weight> best = tourCostFunction<Weight>(TourCostKernel::Auto);
+            (kernel == TourCostKernel::Auto ? best : tourCostFunction<Weight>(kernel))(
+                adjMatrix, batch, batchCount, length, closed, batchCosts);
+        }
+        else {
+            tourCostsScalar(adjMatrix, batch, batchCount, length, closed, batchCosts);
+        }
+    };
+
+    if (pool == nullptr || pool->size() == 1 || count * length < TOUR_COST_PARALLEL_EDGES) {
+        score(tours, count, costs);
+        return;
+    }
+    size_t chunk = std::max<size_t>(1, TOUR_COST_CHUNK_EDGES / std::max(length, 1));
+    pool->parallelFor((count + chunk - 1) / chunk, [&](size_t c) {
+        size_t first = c * chunk;
+        score(tours + first * length, std::min(chunk, count - first), costs + first);
+    });
+}
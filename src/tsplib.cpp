@@ -0,0 +1,258 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <charconv>
+#include <cmath>
+
+#include "mapped_file.cpp"
+
+// Loading instances from the memory mapped text of their files. Numbers are
+// parsed straight from the mapping, with no copies of the text and no
+// streams, and the matrix is allocated once, from the size in the header.
+
+// Reads the numbers and words of a text, throwing std::runtime_error when
+// the text doesn't have what's asked for.
+class TextScanner {
+    const char* p;
+    const char* end;
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+    }
+
+    static std::string_view trim(std::string_view text) {
+        while (!text.empty() && isSpace(text.front())) text.remove_prefix(1);
+        while (!text.empty() && isSpace(text.back())) text.remove_suffix(1);
+        return text;
+    }
+
+public:
+    TextScanner(const char* begin, const char* _end) : p(begin), end(_end) {}
+
+    void skipSpaces() {
+        while (p < end && isSpace(*p)) ++p;
+    }
+
+    bool atEnd() {
+        skipSpaces();
+        return p == end;
+    }
+
+    // the next line, without the spaces around it
+    std::string_view line() {
+        const char* begin = p;
+        while (p < end && *p != '\n') ++p;
+        std::string_view text(begin, p - begin);
+        if (p < end) ++p;
+        return trim(text);
+    }
+
+    // Parses an integer. The loop over its digits has a single comparison,
+    // as a character below '0' wraps around to a large unsigned number.
+    int integer() {
+        skipSpaces();
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) ++p;
+        if (p == end || unsigned(*p - '0') >= 10) {
+            throw std::runtime_error("expected an integer");
+        }
+
+        int64_t value = 0;
+        for (unsigned digit; p < end && (digit = unsigned(*p - '0')) < 10; ++p) {
+            value = value * 10 + digit;
+        }
+        return int(negative ? -value : value);
+    }
+
+    double real() {
+        skipSpaces();
+        double value;
+        auto [next, error] = std::from_chars(p, end, value);
+        if (error != std::errc()) throw std::runtime_error("expected a number");
+        p = next;
+        return value;
+    }
+};
+
+// the header of a TSPLIB file, up to the section with the data
+struct TsplibHeader {
+    int n = 0;
+    std::string weightType = "EXPLICIT";
+    std::string weightFormat = "FULL_MATRIX";
+    // EDGE_WEIGHT_SECTION or NODE_COORD_SECTION
+    std::string section;
+};
+
+// parses the header, leaving `text` at the start of the section with the data
+TsplibHeader parseTsplibHeader(TextScanner& text) {
+    TsplibHeader header;
+    while (header.section.empty()) {
+        if (text.atEnd()) throw std::runtime_error("no EDGE_WEIGHT_SECTION or NODE_COORD_SECTION");
+
+        std::string_view line = text.line();
+        size_t colon = line.find(':');
+        std::string_view key = line.substr(0, colon);
+        std::string_view value = colon == std::string_view::npos ? "" : line.substr(colon + 1);
+        while (!key.empty() && (key.back() == ' ' || key.back() == '\t')) key.remove_suffix(1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+
+        if (key == "DIMENSION") {
+            TextScanner number(value.data(), value.data() + value.size());
+            header.n = number.integer();
+        }
+        else if (key == "EDGE_WEIGHT_TYPE") header.weightType = value;
+        else if (key == "EDGE_WEIGHT_FORMAT") header.weightFormat = value;
+        else if (key == "EDGE_WEIGHT_SECTION" || key == "NODE_COORD_SECTION") header.section = key;
+        else if (key == "EOF") throw std::runtime_error("no EDGE_WEIGHT_SECTION or NODE_COORD_SECTION");
+    }
+    if (header.n <= 0) throw std::runtime_error("no DIMENSION");
+    return header;
+}
+
+// the EDGE_WEIGHT_TYPEs computed from the coordinates of the cities
+enum class CoordinateMetric {
+    Euc2d,
+    Ceil2d,
+    Att,
+    Geo,
+};
+
+CoordinateMetric coordinateMetric(const std::string& weightType) {
+    if (weightType == "EUC_2D") return CoordinateMetric::Euc2d;
+    if (weightType == "CEIL_2D") return CoordinateMetric::Ceil2d;
+    if (weightType == "ATT") return CoordinateMetric::Att;
+    if (weightType == "GEO") return CoordinateMetric::Geo;
+    throw std::runtime_error("unsupported EDGE_WEIGHT_TYPE " + weightType);
+}
+
+// latitude or longitude in radians of a GEO coordinate in degrees.minutes
+double geoRadians(double value) {
+    const double PI = 3.141592;
+    int degrees = int(value);
+    return PI * (degrees + 5.0 * (value - degrees) / 3.0) / 180.0;
+}
+
+// the weight of the edge between the cities at (x1, y1) and (x2, y2), as
+// TSPLIB defines it for `metric`
+int coordinateDistance(CoordinateMetric metric, double x1, double y1, double x2, double y2) {
+    auto nint = [](double value) { return int(value + 0.5); };
+    double dx = x1 - x2, dy = y1 - y2;
+    switch (metric) {
+    case CoordinateMetric::Euc2d:
+        return nint(std::sqrt(dx * dx + dy * dy));
+    case CoordinateMetric::Ceil2d:
+        return int(std::ceil(std::sqrt(dx * dx + dy * dy)));
+    case CoordinateMetric::Att: {
+        double r = std::sqrt((dx * dx + dy * dy) / 10.0);
+        int t = nint(r);
+        return t < r ? t + 1 : t;
+    }
+    default: {
+        const double RRR = 6378.388;
+        double q1 = std::cos(geoRadians(y1) - geoRadians(y2));
+        double q2 = std::cos(geoRadians(x1) - geoRadians(x2));
+        double q3 = std::cos(geoRadians(x1) + geoRadians(x2));
+        return int(RRR * std::acos(0.5 * ((1.0 + q1) * q2 - (1.0 - q1) * q3)) + 1.0);
+    }
+    }
+}
+
+// reads the n cities of a NODE_COORD_SECTION into `x` and `y`
+void parseTsplibCoordinates(TextScanner& text, int n, std::vector<double>& x, std::vector<double>& y) {
+    x.assign(n, 0);
+    y.assign(n, 0);
+    for (int k = 0; k < n; k++) {
+        int city = text.integer() - 1;
+        if (city < 0 || city >= n) throw std::runtime_error("city number out of range");
+        x[city] = text.real();
+        y[city] = text.real();
+    }
+}
+
+// Parses an instance in the TSPLIB format. The weights can be given
+// explicitly, in any of the EDGE_WEIGHT_FORMATs (the full matrix, or one of
+// the triangles of a symmetric one, by rows or by columns, with or without the
+// diagonal), or computed from the coordinates of the cities for the EUC_2D,
+// CEIL_2D, ATT and GEO types. A diagonal that isn't in the file is set to -1.
+// Returns the n * n matrix and sets `n`.
+std::vector<int> parseTsplib(const char* begin, const char* end, int& n) {
+    TextScanner text(begin, end);
+    TsplibHeader header = parseTsplibHeader(text);
+    std::string& weightFormat = header.weightFormat;
+    n = header.n;
+
+    std::vector<int> adjMatrix(size_t(n) * n, -1);
+    auto set = [&](int i, int j, int weight) {
+        adjMatrix[size_t(i) * n + j] = weight;
+        adjMatrix[size_t(j) * n + i] = weight;
+    };
+
+    if (header.weightType == "EXPLICIT") {
+        if (header.section != "EDGE_WEIGHT_SECTION") throw std::runtime_error("no EDGE_WEIGHT_SECTION");
+
+        // the triangles by columns have the same order of the numbers as the
+        // opposite ones by rows, as the matrix is symmetric
+        if (weightFormat == "UPPER_COL") weightFormat = "LOWER_ROW";
+        else if (weightFormat == "LOWER_COL") weightFormat = "UPPER_ROW";
+        else if (weightFormat == "UPPER_DIAG_COL") weightFormat = "LOWER_DIAG_ROW";
+        else if (weightFormat == "LOWER_DIAG_COL") weightFormat = "UPPER_DIAG_ROW";
+
+        if (weightFormat == "FULL_MATRIX") {
+            for (int& weight : adjMatrix) weight = text.integer();
+        }
+        else if (weightFormat == "UPPER_ROW" || weightFormat == "UPPER_DIAG_ROW") {
+            int diagonal = weightFormat == "UPPER_DIAG_ROW" ? 0 : 1;
+            for (int i = 0; i < n; i++) {
+                for (int j = i + diagonal; j < n; j++) set(i, j, text.integer());
+            }
+        }
+        else if (weightFormat == "LOWER_ROW" || weightFormat == "LOWER_DIAG_ROW") {
+            int diagonal = weightFormat == "LOWER_DIAG_ROW" ? 1 : 0;
+            for (int i = 0; i < n; i++) {
+                for (int j = 0; j < i + diagonal; j++) set(i, j, text.integer());
+            }
+        }
+        else {
+            throw std::runtime_error("unsupported EDGE_WEIGHT_FORMAT " + weightFormat);
+        }
+        return adjMatrix;
+    }
+
+    CoordinateMetric metric = coordinateMetric(header.weightType);
+    if (header.section != "NODE_COORD_SECTION") throw std::runtime_error("no NODE_COORD_SECTION");
+    std::vector<double> x, y;
+    parseTsplibCoordinates(text, n, x, y);
+
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) set(i, j, coordinateDistance(metric, x[i], y[i], x[j], y[j]));
+    }
+    return adjMatrix;
+}
+
+// Parses the simple format of the instances in graphs/: the number of cities
+// followed by the full matrix.
+std::vector<int> parseMatrixTxt(const char* begin, const char* end, int& n) {
+    TextScanner text(begin, end);
+    n = text.integer();
+    if (n <= 0) throw std::runtime_error("no number of cities");
+
+    std::vector<int> adjMatrix(size_t(n) * n);
+    for (int& weight : adjMatrix) weight = text.integer();
+    return adjMatrix;
+}
+
+// loads the matrix of the file at `path` with one of the parsers above
+std::vector<int> loadMatrix(const std::string& path, int& n,
+        std::vector<int> (*parse)(const char*, const char*, int&)) {
+    MappedFile file = MappedFile::open(path);
+    const char* text = reinterpret_cast<const char*>(file.bytes());
+    try {
+        return parse(text, text + file.size(), n);
+    }
+    catch (const std::runtime_error& e) {
+        throw std::runtime_error(path + ": " + e.what());
+    }
+}
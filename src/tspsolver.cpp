@@ -1,17 +1,41 @@
 #pragma once
 
 #include "lib.h"
+#include "rng.cpp"
 
+// The base of the solvers that search for a tour with a time limit. Solvers
+// are templates over the type of the instance: a BasicTsp of any weight type,
+// or a CoordinateTsp.
+template <typename Instance>
 class TspSolver {
 private:
-    Tsp instance;
+    Instance instance;
+    uint64_t seed;
 
 public:
-    TspSolver(const Tsp& _instance) : instance(_instance) {}
+    TspSolver(const Instance& _instance) : instance(_instance), seed(randomSeed()) {}
 
     virtual TspSolution solve(int start, float timeoutS) = 0;
 
-    const Tsp& getTsp() const {
+    const Instance& getTsp() const {
         return instance;
     }
-};
\ No newline at end of file
+
+    // Runs with the same seed and number of threads make the same random
+    // choices, so they give the same result unless they're cut short by the
+    // timeout. A new solver gets a random seed.
+    void setSeed(uint64_t _seed) {
+        seed = _seed;
+    }
+
+    uint64_t getSeed() const {
+        return seed;
+    }
+
+protected:
+    // the generator of an independent stream of random numbers, one for each
+    // worker of the solver
+    Rng rng(uint64_t stream = 0) const {
+        return Rng::stream(seed, stream);
+    }
+};